@@ -4,21 +4,36 @@
 #include <linux/i2c.h>
 #include <linux/delay.h>
 #include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/jiffies.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+
+#include "i2c_batch.h"
+#include "lcd.h"
 
-#define I2C_BUS_AVAILABLE   2              // I2C Bus available in BBB
 #define SLAVE_DEVICE_NAME   "HD44780"      // Device and Driver Name
-#define LCD_SLAVE_ADDR   (0x4E >> 1)       // lcd Slave Address
-// 0x4E >> 1 = 01001110 >> 1 = 00100111 = 0x27
 
 #define LCD_CLEAR		0x01
+#define LCD_HOME		0x02
 #define LCD_FN_SET_8BIT	0x30
 #define LCD_FN_SET_4BIT	0x20
 #define LCD_FN_SET_4BIT_2LINES	0x28
 #define LCD_DISP_CTRL	0x08
 #define LCD_DISP_ON		0x0C
 #define LCD_ENTRY_MODE	0x06
-#define LCD_LINE1		0x80
-#define LCD_LINE2		0xC0
+#define LCD_SHIFT_LEFT	0x18
+#define LCD_SET_DDRAM	0x80
+#define LCD_SET_CGRAM	0x40
+#define LCD_CGRAM_SLOTS	8
 
 #define LCD_RS	0
 #define LCD_RW	1
@@ -28,114 +43,910 @@
 #define LCD_CMD		0x80
 #define LCD_DATA	1
 
+// Bytes one character (or command) takes in a stream: two nibbles, EN high then low
+#define LCD_NIBBLE_BYTES	4
+// Instructions up to this long are paced with idle bytes inside a stream,
+// longer ones (clear, home) end the transfer and are waited for
+#define LCD_STREAM_MAX_NS	100000
+// Idle bytes after one instruction at the fastest bus clock (1 MHz, 9 us per byte)
+#define LCD_MAX_PAD	DIV_ROUND_UP(LCD_STREAM_MAX_NS, 9000)
+// The table assumes fosc = 270 kHz; panels run anywhere from 190 kHz up
+#define LCD_EXEC_MARGIN_PCT	150
+
+// In 2-line mode DDRAM holds 40 characters per line, at 0x00 and 0x40
+#define LCD_DDRAM_ROWS	2
+#define LCD_DDRAM_COLS	40
+#define LCD_CELL_UNKNOWN	-1
+
+// Largest panel: 4 rows of 20 or 2 rows of 40 characters
+#define LCD_MAX_ROWS	4
+#define LCD_MAX_CELLS	(LCD_DDRAM_ROWS * LCD_DDRAM_COLS)
+
+#define LCD_MAX_PANELS	8
+
+// Marquee: shortest step, and blanks between the end of the text and its repeat
+#define LCD_MARQUEE_MIN_MS	20
+#define LCD_MARQUEE_GAP	4
+
 #define BV(n)       (1 << (n))
-#define __NOP()     asm("nop")
 typedef unsigned char uint8_t;
 
-static struct i2c_adapter *desd_i2c_adapter    = NULL;  // I2C Adapter Structure
-static struct i2c_client  *desd_i2c_client_lcd = NULL;  // I2C Cient Structure (In our case it is lcd)
+// Visible rows x cols and the DDRAM address each row starts at. Every panel
+// runs the controller in 2-line mode; 4-row panels show each 40 character
+// DDRAM line as two rows of 20.
+enum { LCD_16X2, LCD_20X4, LCD_40X2 };
+static const struct lcd_geometry_def {
+	unsigned int rows, cols;
+	uint8_t row_addr[LCD_MAX_ROWS];
+} lcd_geometries[] = {
+	[LCD_16X2] = { 2, 16, { 0x00, 0x40 } },
+	[LCD_20X4] = { 4, 20, { 0x00, 0x40, 0x14, 0x54 } },
+	[LCD_40X2] = { 2, 40, { 0x00, 0x40 } },
+};
+
+// Glyph definitions from LCD_IOC_DEFINE_GLYPH; gen changes on every
+// definition so a slot holding an older one is known to be stale
+struct lcd_glyph_def {
+	uint8_t rows[8];
+	unsigned int gen; // 0: not defined
+};
+
+// One panel, allocated at probe. Open files hold a reference, so the state
+// outlives a removal until the last of them is closed.
+struct desd_lcd {
+	struct kref kref;
+	struct i2c_client *client;
+	const struct lcd_geometry_def *geo;
+	int minor;
+	struct cdev *cdev;
+
+	// Shadow copy of DDRAM: what the controller holds, or LCD_CELL_UNKNOWN where
+	// that is not known (before init, after a failed transfer)
+	short shadow[LCD_DDRAM_ROWS][LCD_DDRAM_COLS];
+	unsigned long bytes_sent; // expander bytes LcdPutn() put on the bus
+	unsigned long bytes_full; // what rewriting each string in full would have cost
+
+	// Screen text: rows * cols characters at the start of a vmalloc_user() page
+	char *text;
+	struct mutex text_lock; // held for copies only, never across I2C
+	bool gone;              // removed, no new flushes
+	atomic_t maps;          // mappings of text
+	struct workqueue_struct *wq; // this panel's refresh worker
+	struct delayed_work flush_work;
 
-int LcdWriteByte(uint8_t val) {
-	return i2c_master_send(desd_i2c_client_lcd, &val, 1);
+	// Glyphs (text_lock) and the CGRAM slot cache (flush work only): which
+	// glyph each slot holds and when a flush last needed it, for LRU
+	struct lcd_glyph_def glyphs[LCD_GLYPHS];
+	unsigned int glyph_gen;
+	struct {
+		int glyph; // -1: none, or content unknown
+		unsigned int gen;
+		unsigned long used;
+	} slots[LCD_CGRAM_SLOTS];
+	unsigned long flush_seq;
+	unsigned long glyph_hits, glyph_uploads;
+
+	// Marquee as requested (text_lock; gen counts requests), and as shown
+	// (marquee work only): stream position of the first visible character
+	// and the display shift the controller has now
+	char mq_text[LCD_MARQUEE_MAX];
+	unsigned int mq_len, mq_row, mq_step_ms, mq_flags, mq_gen;
+	unsigned int mq_shown;
+	unsigned long mq_pos;
+	unsigned int shift;
+	unsigned long mq_steps;
+	struct delayed_work marquee_work;
+};
+
+static dev_t desd_lcd_devno;
+static struct class *desd_lcd_class;
+static DEFINE_IDR(desd_lcd_idr); // minor -> struct desd_lcd
+static DEFINE_MUTEX(desd_lcd_idr_lock);
+
+static unsigned int bus_khz = 100;
+module_param(bus_khz, uint, 0444);
+MODULE_PARM_DESC(bus_khz, "I2C bus clock of the LCD backpack in kHz, up to 1000 (sets the idle bytes between characters)");
+
+static bool busy_poll;
+module_param(busy_poll, bool, 0444);
+MODULE_PARM_DESC(busy_poll, "PCF8574 P1 is wired to RW: poll the busy flag after clear/home instead of sleeping");
+
+// Execution time of each instruction in ns (HD44780 datasheet table 6,
+// fosc = 270 kHz), indexed by the highest set bit of the command byte
+static const unsigned int lcd_exec_ns[8] = {
+	1520000,	// 0x01 clear display
+	1520000,	// 0x02 return home
+	37000,		// 0x04 entry mode set
+	37000,		// 0x08 display on/off control
+	37000,		// 0x10 cursor or display shift
+	37000,		// 0x20 function set
+	37000,		// 0x40 set CGRAM address
+	37000,		// 0x80 set DDRAM address
+};
+// Writing data to CG or DDRAM: 37 us, then 4 us until the address counter moves
+#define LCD_DATA_EXEC_NS	41000
+
+// How long the HD44780 needs for an instruction or data write, with margin
+static unsigned int LcdExecNs(uint8_t rs, uint8_t val) {
+	unsigned int ns;
+
+	if (rs != LCD_CMD || !val)
+		ns = LCD_DATA_EXEC_NS;
+	else
+		ns = lcd_exec_ns[fls(val) - 1];
+	return ns / 100 * LCD_EXEC_MARGIN_PCT;
 }
 
-void LcdWrite(uint8_t rs, uint8_t val) {
+// Idle expander bytes needed after an instruction so the HD44780 has executed
+// it before the next EN pulse arrives in the same stream. One byte on the bus
+// is 9 clocks: 90 us at 100 kHz, 22.5 us at 400 kHz.
+static unsigned int LcdPadBytes(unsigned int exec_ns) {
+	unsigned int byte_ns = 9 * 1000000 / clamp(bus_khz, 10U, 1000U);
+
+	if (exec_ns > LCD_STREAM_MAX_NS)
+		return 0; // waited for after the transfer
+	return DIV_ROUND_UP(exec_ns, byte_ns) - 1;
+}
+
+// Appends the expander bytes that clock val into the LCD, plus the idle bytes
+// its execution time asks for. Returns the position after them.
+static uint8_t *LcdEncode(uint8_t *p, uint8_t rs, uint8_t val) {
 	uint8_t high = val & 0xF0, low = (val << 4) & 0xF0;
 	uint8_t bvrs = (rs == LCD_CMD) ? 0 : BV(LCD_RS);
-	LcdWriteByte(high | bvrs | BV(LCD_EN) | BV(LCD_BL));
-	mdelay(1);
-	LcdWriteByte(high | bvrs | BV(LCD_BL));
+	unsigned int pad = LcdPadBytes(LcdExecNs(rs, val));
+
+	*p++ = high | bvrs | BV(LCD_EN) | BV(LCD_BL);
+	*p++ = high | bvrs | BV(LCD_BL);
+	*p++ = low | bvrs | BV(LCD_EN) | BV(LCD_BL);
+	*p++ = low | bvrs | BV(LCD_BL);
+	while (pad--)
+		*p++ = low | bvrs | BV(LCD_BL);
+	return p;
+}
+
+// One EN pulse with val on the data lines: the PCF8574 latches every byte of a
+// write message, so EN high and EN low go out in a single transaction. The I2C
+// byte time (22 us at 400 kHz) is far above the 450 ns EN pulse width.
+int LcdPulse(struct desd_lcd *lcd, uint8_t val) {
+	uint8_t buf[2] = { val | BV(LCD_EN), val };
+	struct i2c_batch b;
+
+	i2c_batch_init(&b, lcd->client);
+	i2c_batch_write(&b, buf, sizeof(buf));
+	return i2c_batch_run(&b);
+}
+
+// Reads the busy flag through the PCF8574. With RW high and D7..D4 released
+// (written high), EN high makes the LCD drive BF on D7; both nibbles have to
+// be clocked out. RW changes a byte before EN rises to meet its setup time.
+// One transaction per poll. Returns 1 while busy, 0 when ready.
+static int LcdBusy(struct desd_lcd *lcd) {
+	uint8_t rd = 0xF0 | BV(LCD_RW) | BV(LCD_BL);
+	uint8_t hi[2] = { rd, rd | BV(LCD_EN) };
+	uint8_t lo[4] = { rd, rd | BV(LCD_EN), rd, BV(LCD_BL) };
+	uint8_t in;
+	struct i2c_batch b;
+	int ret;
+
+	i2c_batch_init(&b, lcd->client);
+	i2c_batch_write(&b, hi, sizeof(hi));
+	i2c_batch_read(&b, &in, 1);
+	i2c_batch_write(&b, lo, sizeof(lo));
+	ret = i2c_batch_run(&b);
+	if (ret)
+		return ret;
+	return !!(in & 0x80);
+}
+
+// Waits out an instruction too long to pad in the stream: polls the busy
+// flag where RW is wired, otherwise sleeps for the table time
+static int LcdWait(struct desd_lcd *lcd, unsigned int exec_ns) {
+	unsigned long timeout;
+	int ret;
+
+	if (!busy_poll) {
+		usleep_range(exec_ns / 1000, exec_ns / 1000 + exec_ns / 4000);
+		return 0;
+	}
+	timeout = jiffies + usecs_to_jiffies(2 * exec_ns / 1000) + 1;
+	while ((ret = LcdBusy(lcd)) > 0) {
+		if (time_after(jiffies, timeout))
+			return -ETIMEDOUT;
+		usleep_range(100, 200);
+	}
+	return ret;
+}
+
+// Both nibbles of a command or character in one transaction, followed by as
+// much waiting as the instruction needs: idle bytes for most, a sleep or
+// busy flag poll for clear and home.
+int LcdWrite(struct desd_lcd *lcd, uint8_t rs, uint8_t val) {
+	uint8_t buf[LCD_NIBBLE_BYTES + LCD_MAX_PAD], *p;
+	unsigned int exec_ns = LcdExecNs(rs, val);
+	struct i2c_batch b;
+	int ret;
+
+	p = LcdEncode(buf, rs, val);
+	i2c_batch_init(&b, lcd->client);
+	i2c_batch_write(&b, buf, p - buf);
+	ret = i2c_batch_run(&b);
+	if (ret == 0 && exec_ns > LCD_STREAM_MAX_NS)
+		ret = LcdWait(lcd, exec_ns);
+	return ret;
+}
+
+static void LcdShadowFill(struct desd_lcd *lcd, short val) {
+	int row, col;
 
-	LcdWriteByte(low | bvrs | BV(LCD_EN) | BV(LCD_BL));
-	mdelay(1);
-	LcdWriteByte(low | bvrs | BV(LCD_BL));
+	for (row = 0; row < LCD_DDRAM_ROWS; row++)
+		for (col = 0; col < LCD_DDRAM_COLS; col++)
+			lcd->shadow[row][col] = val;
+}
+
+static void LcdSlotsReset(struct desd_lcd *lcd) {
+	int s;
+
+	for (s = 0; s < LCD_CGRAM_SLOTS; s++) {
+		lcd->slots[s].glyph = -1;
+		lcd->slots[s].used = 0;
+	}
+}
+
+// Least recently used slot no glyph of the current flush (seq) is in
+static int LcdLruSlot(struct desd_lcd *lcd, unsigned long seq) {
+	int s, best = -1;
+
+	for (s = 0; s < LCD_CGRAM_SLOTS; s++)
+		if (lcd->slots[s].used != seq && (best < 0 || lcd->slots[s].used < lcd->slots[best].used))
+			best = s;
+	return best;
+}
+
+// Replaces the glyph bytes in text with the CGRAM slots holding the glyphs,
+// uploading the ones not in CGRAM yet in a single transfer: per glyph a CGRAM
+// address command and its 8 rows. Glyphs already on the panel cost nothing.
+// A redefined glyph is uploaded again into the slot it is in, so the cells
+// showing it change with the CGRAM write alone and need no DDRAM writes.
+static void LcdMapGlyphs(struct desd_lcd *lcd, char *text, int ncells, const struct lcd_glyph_def *glyphs) {
+	unsigned int step = LCD_NIBBLE_BYTES + LcdPadBytes(LcdExecNs(LCD_DATA, 0));
+	unsigned long seq = ++lcd->flush_seq;
+	int slot_of[LCD_GLYPHS], home[LCD_GLYPHS], loaded[LCD_CGRAM_SLOTS];
+	uint8_t *buf = NULL, *p = NULL;
+	struct i2c_batch b;
+	int g, s, i, n = 0, ret = -ENOMEM;
+	char *c;
+
+	for (g = 0; g < LCD_GLYPHS; g++) {
+		slot_of[g] = -2; // not on screen
+		home[g] = -1;    // no slot with an older definition
+	}
+	for (c = text; c < text + ncells; c++) {
+		g = (uint8_t)*c - LCD_GLYPH_FIRST;
+		if (g < 0 || g >= LCD_GLYPHS)
+			continue;
+		if (glyphs[g].gen)
+			slot_of[g] = -1; // needs a slot
+		else
+			*c = ' ';
+	}
+
+	// Hits first, so that uploads never evict a glyph this frame shows
+	for (s = 0; s < LCD_CGRAM_SLOTS; s++) {
+		g = lcd->slots[s].glyph;
+		if (g < 0 || slot_of[g] != -1)
+			continue;
+		lcd->slots[s].used = seq;
+		if (lcd->slots[s].gen != glyphs[g].gen) {
+			home[g] = s; // redefined, upload again into the same slot
+			continue;
+		}
+		slot_of[g] = s;
+		lcd->glyph_hits++;
+	}
+
+	for (g = 0; g < LCD_GLYPHS; g++) {
+		if (slot_of[g] != -1)
+			continue;
+		s = home[g] >= 0 ? home[g] : LcdLruSlot(lcd, seq);
+		if (s < 0)
+			break; // more than 8 glyphs on screen
+		// Only frames with a glyph to upload pay for the buffer
+		if (!buf) {
+			buf = kmalloc_array(LCD_CGRAM_SLOTS * 9, step, GFP_KERNEL);
+			if (!buf)
+				break;
+			p = buf;
+		}
+		lcd->slots[s].glyph = -1;
+		lcd->slots[s].used = seq;
+		slot_of[g] = s;
+		loaded[n++] = g;
+		p = LcdEncode(p, LCD_CMD, LCD_SET_CGRAM | (s << 3));
+		for (i = 0; i < 8; i++)
+			p = LcdEncode(p, LCD_DATA, glyphs[g].rows[i] & 0x1F);
+	}
+	if (n) {
+		i2c_batch_init(&b, lcd->client);
+		i2c_batch_write(&b, buf, p - buf);
+		ret = i2c_batch_run(&b);
+	}
+	kfree(buf);
+	for (i = 0; i < n; i++) {
+		s = slot_of[loaded[i]];
+		if (ret) {
+			slot_of[loaded[i]] = -1;
+			continue;
+		}
+		lcd->slots[s].glyph = loaded[i];
+		lcd->slots[s].gen = glyphs[loaded[i]].gen;
+		lcd->glyph_uploads++;
+	}
+
+	for (c = text; c < text + ncells; c++) {
+		g = (uint8_t)*c - LCD_GLYPH_FIRST;
+		if (g >= 0 && g < LCD_GLYPHS)
+			*c = slot_of[g] >= 0 ? slot_of[g] : ' ';
+	}
 }
 
 // As per 4-bit initialization sequence mentioned HD44780 datasheet fig 24 (page 46)
-int LcdInit(void) {
+// All waits sleep: the shortest one the datasheet asks for is 100 us, and the
+// sub-microsecond EN timing is covered by the I2C byte time. After the switch
+// to 4-bit mode LcdWrite() waits as long as each instruction needs.
+int LcdInit(struct desd_lcd *lcd) {
 	int ret;
-    // wait for min 15 ms (for 5V)
-	mdelay(20);
+	LcdShadowFill(lcd, LCD_CELL_UNKNOWN);
+	LcdSlotsReset(lcd);
+	// wait for min 15 ms (for 5V)
+	usleep_range(20000, 25000);
 
 	// attention sequence
-	ret = LcdWriteByte(LCD_FN_SET_8BIT | BV(LCD_EN));
+	ret = LcdPulse(lcd, LCD_FN_SET_8BIT);
 	// check if lcd is ready
-    if(ret != 0)
-        return -1;
-	__NOP();
-	LcdWriteByte(LCD_FN_SET_8BIT);
-	mdelay(5);
-
-	LcdWriteByte(LCD_FN_SET_8BIT | BV(LCD_EN));
-	__NOP();
-	LcdWriteByte(LCD_FN_SET_8BIT);
-	mdelay(1);
-
-	LcdWriteByte(LCD_FN_SET_8BIT | BV(LCD_EN));
-	__NOP();
-	LcdWriteByte(LCD_FN_SET_8BIT);
-	mdelay(3);
-
-	LcdWriteByte(LCD_FN_SET_4BIT | BV(LCD_EN));
-	__NOP();
-	LcdWriteByte(LCD_FN_SET_4BIT);
-	mdelay(3);
+	if(ret != 0)
+		return -1;
+	usleep_range(4100, 5000);
+
+	LcdPulse(lcd, LCD_FN_SET_8BIT);
+	usleep_range(100, 200);
+
+	LcdPulse(lcd, LCD_FN_SET_8BIT);
+	usleep_range(100, 200);
+
+	LcdPulse(lcd, LCD_FN_SET_4BIT);
+	usleep_range(100, 200);
 
 	// lcd initialization
-	LcdWriteByte(LCD_FN_SET_4BIT_2LINES);
-	mdelay(1);
-	LcdWrite(LCD_CMD, LCD_DISP_CTRL);
-	mdelay(1);
-	LcdWrite(LCD_CMD, LCD_CLEAR);
-	mdelay(1);
-	LcdWrite(LCD_CMD, LCD_ENTRY_MODE);
-	mdelay(1);
-	LcdWrite(LCD_CMD, LCD_DISP_ON);
-	mdelay(1);
+	LcdWrite(lcd, LCD_CMD, LCD_FN_SET_4BIT_2LINES);
+	LcdWrite(lcd, LCD_CMD, LCD_DISP_CTRL);
+	LcdWrite(lcd, LCD_CMD, LCD_CLEAR);
+	LcdShadowFill(lcd, ' ');
+	LcdWrite(lcd, LCD_CMD, LCD_ENTRY_MODE);
+	LcdWrite(lcd, LCD_CMD, LCD_DISP_ON);
 	return ret;
 }
 
-// call this functiond from device write operation.
-void LcdPuts(uint8_t line, char str[]) {
-	int i;
-	LcdWrite(LCD_CMD, line); // line address
-	mdelay(1);
-	for(i=0; str[i]!='\0'; i++)
-		LcdWrite(LCD_DATA, str[i]);
+// True if cell i of the string differs from what DDRAM holds
+static bool LcdDirty(const short *cell, const char *str, int i) {
+	return cell[i] != (uint8_t)str[i];
+}
+
+// Writes len characters of str starting at DDRAM address line.
+// Only the characters that differ from the shadow copy are sent: each run of
+// changed cells as a DDRAM address command plus the characters. A single
+// unchanged cell between two runs is resent rather than paying for another
+// address command. All runs go out as one write message, with the bus clock
+// itself pacing the characters.
+int LcdPutn(struct desd_lcd *lcd, uint8_t line, const char *str, int len) {
+	// data writes are the slowest instructions a run contains
+	unsigned int step = LCD_NIBBLE_BYTES + LcdPadBytes(LcdExecNs(LCD_DATA, 0));
+	uint8_t addr = line & ~LCD_SET_DDRAM;
+	int row = addr >= 0x40, col = addr - row * 0x40;
+	short *cell;
+	uint8_t *buf, *p;
+	struct i2c_batch b;
+	int i, j, end, ret;
+
+	if (col >= LCD_DDRAM_COLS)
+		return -EINVAL;
+	len = min(len, LCD_DDRAM_COLS - col);
+	cell = &lcd->shadow[row][col];
+
+	// at most an address command per character
+	buf = kmalloc_array(2 * len, step, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	p = buf;
+	for (i = 0; i < len; i = end) {
+		end = i + 1;
+		if (!LcdDirty(cell, str, i))
+			continue;
+		while (end < len && (LcdDirty(cell, str, end) || (end + 1 < len && LcdDirty(cell, str, end + 1))))
+			end++;
+
+		p = LcdEncode(p, LCD_CMD, LCD_SET_DDRAM | (addr + i));
+		for (j = i; j < end; j++)
+			p = LcdEncode(p, LCD_DATA, str[j]);
+	}
+	if (p == buf) {
+		kfree(buf);
+		lcd->bytes_full += (len + 1) * step;
+		return 0;
+	}
+
+	i2c_batch_init(&b, lcd->client);
+	i2c_batch_write(&b, buf, p - buf);
+	ret = i2c_batch_run(&b);
+	kfree(buf);
+
+	for (i = 0; i < len; i++)
+		cell[i] = ret ? LCD_CELL_UNKNOWN : (uint8_t)str[i];
+	if (!ret) {
+		lcd->bytes_sent += p - buf;
+		lcd->bytes_full += (len + 1) * step;
+	}
+	return ret;
+}
+
+// /dev/lcdN: write() only updates the panel's text and returns; its flush
+// work puts it on the panel refresh_ms later, so every write arriving in
+// between is covered by the same flush and callers never wait for the I2C bus.
+// The text is a vmalloc_user() page so it can also be mapped; while it is,
+// the flush work runs every refresh_ms to pick up changes made in place.
+// Each panel flushes on its own ordered workqueue: a slow or stuck panel
+// only delays its own updates, never those of the others.
+static unsigned int refresh_ms = 50;
+module_param(refresh_ms, uint, 0644);
+MODULE_PARM_DESC(refresh_ms, "Delay from a write() to the panel update covering it, in ms (at least 10)");
+
+// refresh_ms can be changed at any time; below the minimum a mapped panel's
+// flush would re-arm itself back to back and keep the bus busy
+#define LCD_MIN_REFRESH_MS	10
+
+static unsigned long LcdRefreshDelay(void) {
+	return msecs_to_jiffies(max(READ_ONCE(refresh_ms), (unsigned int)LCD_MIN_REFRESH_MS));
+}
+
+static void LcdRelease(struct kref *kref) {
+	struct desd_lcd *lcd = container_of(kref, struct desd_lcd, kref);
+
+	vfree(lcd->text);
+	kfree(lcd);
+}
+
+static inline int LcdCells(struct desd_lcd *lcd) {
+	return lcd->geo->rows * lcd->geo->cols;
 }
 
-// lcd_open()
-// lcd_close()
-// lcd_read() -- do nothing
-// lcd_write()
-    // 1. copy data from user buf to kernel buf
-    // 2. send data to lcd device from kernel buf -- LcdPuts()
+// Brings the panel in line with its text; LcdPutn() skips what is already there
+static void LcdFlush(struct work_struct *work) {
+	struct desd_lcd *lcd = container_of(to_delayed_work(work), struct desd_lcd, flush_work);
+	const struct lcd_geometry_def *geo = lcd->geo;
+	char text[LCD_MAX_CELLS];
+	struct lcd_glyph_def glyphs[LCD_GLYPHS];
+	int row, mq_row;
+
+	mutex_lock(&lcd->text_lock);
+	memcpy(text, lcd->text, LcdCells(lcd));
+	memcpy(glyphs, lcd->glyphs, sizeof(glyphs));
+	mq_row = lcd->mq_step_ms ? lcd->mq_row : -1; // drawn by the marquee work
+	mutex_unlock(&lcd->text_lock);
+
+	LcdMapGlyphs(lcd, text, LcdCells(lcd), glyphs);
+
+	for (row = 0; row < geo->rows; row++)
+		if (row != mq_row && LcdPutn(lcd, LCD_SET_DDRAM | geo->row_addr[row], text + row * geo->cols, geo->cols))
+			pr_info("lcd%d: update of line %d failed, resent on the next write\n", lcd->minor, row + 1);
+
+	// Mapped text changes without telling the driver: keep looking
+	if (atomic_read(&lcd->maps) && !READ_ONCE(lcd->gone))
+		queue_delayed_work(lcd->wq, &lcd->flush_work, LcdRefreshDelay());
+}
+
+// Character p of the endless marquee stream: the text, then blanks up to the period
+static char LcdMarqueeChar(const char *text, unsigned int len, unsigned int period, unsigned long p) {
+	p %= period;
+	return p < len ? text[p] : ' ';
+}
+
+// One marquee step, on the panel's workqueue so it never overlaps a flush.
+// Software marquee: the row's window onto the stream moves by one and
+// LcdPutn() sends the cells that changed. Display shift marquee: the row's
+// whole DDRAM line holds the 40 stream characters from mq_pos on, so a step
+// is one shift instruction; the cell that scrolled out on the left gets
+// character mq_pos + 40, which for a period of 40 it already holds.
+static void LcdMarquee(struct work_struct *work) {
+	struct desd_lcd *lcd = container_of(to_delayed_work(work), struct desd_lcd, marquee_work);
+	const struct lcd_geometry_def *geo = lcd->geo;
+	char text[LCD_MARQUEE_MAX], line[LCD_DDRAM_COLS];
+	unsigned int len, row, step_ms, flags, gen, period, i;
+	bool shift_mode;
+	uint8_t addr;
+
+	mutex_lock(&lcd->text_lock);
+	memcpy(text, lcd->mq_text, sizeof(text));
+	len = lcd->mq_len;
+	row = lcd->mq_row;
+	step_ms = lcd->mq_step_ms;
+	flags = lcd->mq_flags;
+	gen = lcd->mq_gen;
+	mutex_unlock(&lcd->text_lock);
+
+	shift_mode = flags & LCD_MARQUEE_SHIFT;
+	period = max(len + LCD_MARQUEE_GAP, shift_mode ? LCD_DDRAM_COLS : geo->cols);
+	addr = LCD_SET_DDRAM | geo->row_addr[row];
+
+	if (gen != lcd->mq_shown) {
+		// New marquee or stopped: start over from an unshifted display
+		if (lcd->shift) {
+			if (LcdWrite(lcd, LCD_CMD, LCD_HOME))
+				goto requeue;
+			lcd->shift = 0;
+		}
+		lcd->mq_shown = gen;
+		lcd->mq_pos = 0;
+		// rows no longer under a marquee get their text back
+		mod_delayed_work(lcd->wq, &lcd->flush_work, 0);
+		if (!step_ms)
+			return;
+		if (shift_mode) {
+			for (i = 0; i < LCD_DDRAM_COLS; i++)
+				line[i] = LcdMarqueeChar(text, len, period, i);
+			LcdPutn(lcd, addr, line, LCD_DDRAM_COLS);
+		}
+	} else if (shift_mode) {
+		if (LcdWrite(lcd, LCD_CMD, LCD_SHIFT_LEFT))
+			goto requeue;
+		lcd->shift = (lcd->shift + 1) % LCD_DDRAM_COLS;
+		line[0] = LcdMarqueeChar(text, len, period, lcd->mq_pos + LCD_DDRAM_COLS);
+		LcdPutn(lcd, addr + lcd->mq_pos % LCD_DDRAM_COLS, line, 1);
+		lcd->mq_pos++;
+		lcd->mq_steps++;
+	} else {
+		lcd->mq_pos++;
+		lcd->mq_steps++;
+	}
+
+	if (!shift_mode) {
+		for (i = 0; i < geo->cols; i++)
+			line[i] = LcdMarqueeChar(text, len, period, lcd->mq_pos + i);
+		LcdPutn(lcd, addr, line, geo->cols);
+	}
+requeue:
+	if (!READ_ONCE(lcd->gone))
+		queue_delayed_work(lcd->wq, &lcd->marquee_work, step_ms ? msecs_to_jiffies(step_ms) : LcdRefreshDelay());
+}
+
+static int lcd_open(struct inode *inode, struct file *file) {
+	struct desd_lcd *lcd;
+
+	mutex_lock(&desd_lcd_idr_lock);
+	lcd = idr_find(&desd_lcd_idr, iminor(inode));
+	if (lcd)
+		kref_get(&lcd->kref);
+	mutex_unlock(&desd_lcd_idr_lock);
+	if (!lcd)
+		return -ENODEV;
+	file->private_data = lcd;
+	return 0;
+}
+
+static int lcd_close(struct inode *inode, struct file *file) {
+	struct desd_lcd *lcd = file->private_data;
+
+	kref_put(&lcd->kref, LcdRelease);
+	return 0;
+}
+
+// The file is the screen, row after row: the file position is the cell
+// written next. '\n' blanks the rest of the row and moves to the next one,
+// except right after a row was filled completely, so echo of a full-width
+// line does not leave an empty row behind. That includes the last row: its
+// '\n' is taken although no cell is left.
+static ssize_t lcd_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+	struct desd_lcd *lcd = file->private_data;
+	int cols = lcd->geo->cols, cells = LcdCells(lcd);
+	char kbuf[64], *cell;
+	loff_t pos = *ppos;
+	size_t done = 0, n, i;
+	bool wrapped = false, fault = false;
+	ssize_t ret;
+
+	if (pos < 0)
+		return -EINVAL;
+	if (!count)
+		return 0;
+	if (pos >= cells)
+		return -ENOSPC;
+
+	mutex_lock(&lcd->text_lock);
+	if (lcd->gone) {
+		ret = -ENODEV;
+		goto out;
+	}
+	while (done < count && (pos < cells || wrapped)) {
+		n = min(count - done, sizeof(kbuf));
+		if (copy_from_user(kbuf, buf + done, n)) {
+			fault = true;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (pos == cells && !(wrapped && kbuf[i] == '\n'))
+				break;
+			cell = lcd->text + pos;
+			if (kbuf[i] == '\n') {
+				if (!wrapped) {
+					memset(cell, ' ', cols - pos % cols);
+					pos += cols - pos % cols;
+				}
+				wrapped = false;
+				continue;
+			}
+			*cell = kbuf[i];
+			pos++;
+			wrapped = pos % cols == 0;
+		}
+		done += i;
+		if (i < n)
+			break;
+	}
+	// A fault after some bytes were taken is a short write
+	if (!done) {
+		ret = fault ? -EFAULT : 0;
+		goto out;
+	}
+
+	// Already pending: this write is picked up by that flush
+	queue_delayed_work(lcd->wq, &lcd->flush_work, LcdRefreshDelay());
+	*ppos = pos;
+	ret = done;
+out:
+	mutex_unlock(&lcd->text_lock);
+	return ret;
+}
+
+static loff_t lcd_llseek(struct file *file, loff_t offset, int whence) {
+	struct desd_lcd *lcd = file->private_data;
+
+	return fixed_size_llseek(file, offset, whence, LcdCells(lcd));
+}
+
+static long lcd_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+	struct desd_lcd *lcd = file->private_data;
+	struct lcd_geometry geo = { .rows = lcd->geo->rows, .cols = lcd->geo->cols };
+	struct lcd_glyph glyph;
+	struct lcd_marquee mq;
+	long ret = 0;
+
+	switch (cmd) {
+	case LCD_IOC_REFRESH:
+		mutex_lock(&lcd->text_lock);
+		if (lcd->gone)
+			ret = -ENODEV;
+		else
+			mod_delayed_work(lcd->wq, &lcd->flush_work, 0);
+		mutex_unlock(&lcd->text_lock);
+		return ret;
+	case LCD_IOC_DEFINE_GLYPH:
+		if (copy_from_user(&glyph, (void __user *)arg, sizeof(glyph)))
+			return -EFAULT;
+		if (glyph.code < LCD_GLYPH_FIRST || glyph.code >= LCD_GLYPH_FIRST + LCD_GLYPHS)
+			return -EINVAL;
+		mutex_lock(&lcd->text_lock);
+		if (lcd->gone) {
+			ret = -ENODEV;
+		} else {
+			// The glyph may be on screen already: redraw it like a write would
+			memcpy(lcd->glyphs[glyph.code - LCD_GLYPH_FIRST].rows, glyph.rows, 8);
+			lcd->glyphs[glyph.code - LCD_GLYPH_FIRST].gen = ++lcd->glyph_gen;
+			queue_delayed_work(lcd->wq, &lcd->flush_work, LcdRefreshDelay());
+		}
+		mutex_unlock(&lcd->text_lock);
+		return ret;
+	case LCD_IOC_MARQUEE:
+		if (copy_from_user(&mq, (void __user *)arg, sizeof(mq)))
+			return -EFAULT;
+		if (mq.row >= lcd->geo->rows || (mq.step_ms && mq.step_ms < LCD_MARQUEE_MIN_MS) ||
+		    (mq.flags & ~LCD_MARQUEE_SHIFT))
+			return -EINVAL;
+		// The display shift moves whole DDRAM lines: 2 rows with columns to spare
+		if ((mq.flags & LCD_MARQUEE_SHIFT) && (lcd->geo->rows != 2 || lcd->geo->cols >= LCD_DDRAM_COLS))
+			return -EINVAL;
+		mutex_lock(&lcd->text_lock);
+		if (lcd->gone) {
+			ret = -ENODEV;
+		} else {
+			memcpy(lcd->mq_text, mq.text, sizeof(mq.text));
+			lcd->mq_len = strnlen(mq.text, sizeof(mq.text));
+			lcd->mq_row = mq.row;
+			lcd->mq_step_ms = mq.step_ms;
+			lcd->mq_flags = mq.flags;
+			lcd->mq_gen++;
+			mod_delayed_work(lcd->wq, &lcd->marquee_work, 0);
+		}
+		mutex_unlock(&lcd->text_lock);
+		return ret;
+	case LCD_IOC_GET_GEOMETRY:
+		if (copy_to_user((void __user *)arg, &geo, sizeof(geo)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static void lcd_vm_open(struct vm_area_struct *vma) {
+	struct desd_lcd *lcd = vma->vm_private_data;
+
+	atomic_inc(&lcd->maps);
+}
+
+static void lcd_vm_close(struct vm_area_struct *vma) {
+	struct desd_lcd *lcd = vma->vm_private_data;
+
+	atomic_dec(&lcd->maps);
+}
+
+static const struct vm_operations_struct lcd_vm_ops = {
+	.open = lcd_vm_open,
+	.close = lcd_vm_close,
+};
+
+// Maps the text page; the first mapping starts the periodic flush
+static int lcd_mmap(struct file *file, struct vm_area_struct *vma) {
+	struct desd_lcd *lcd = file->private_data;
+	int ret;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
+
+	mutex_lock(&lcd->text_lock);
+	if (lcd->gone) {
+		ret = -ENODEV;
+		goto out;
+	}
+	ret = remap_vmalloc_range(vma, lcd->text, 0);
+	if (ret)
+		goto out;
+	vma->vm_private_data = lcd;
+	vma->vm_ops = &lcd_vm_ops;
+	lcd_vm_open(vma);
+	queue_delayed_work(lcd->wq, &lcd->flush_work, LcdRefreshDelay());
+out:
+	mutex_unlock(&lcd->text_lock);
+	return ret;
+}
+
+static const struct file_operations desd_lcd_fops = {
+	.owner = THIS_MODULE,
+	.open = lcd_open,
+	.release = lcd_close,
+	.write = lcd_write,
+	.llseek = lcd_llseek,
+	.unlocked_ioctl = lcd_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.mmap = lcd_mmap,
+};
 
 static int desd_lcd_probe(struct i2c_client *client, const struct i2c_device_id *id) {
-    int ret;
-    pr_info("lcd Probed!!!\n");
-	ret = LcdInit();
-    if(ret != 0) {
-        pr_info("LCD not ready/available.\n");
-        return ret;
-    }
-    pr_info("LCD is initialized.\n");
-    // allocate device number
-    // create device class and device file
-    // init cdev (with fops) and add it in kernel
-    return ret;
+	struct desd_lcd *lcd;
+	dev_t devno;
+	int ret;
+
+	pr_info("lcd Probed!!!\n");
+	lcd = kzalloc(sizeof(*lcd), GFP_KERNEL);
+	if (!lcd)
+		return -ENOMEM;
+	kref_init(&lcd->kref);
+	mutex_init(&lcd->text_lock);
+	INIT_DELAYED_WORK(&lcd->flush_work, LcdFlush);
+	INIT_DELAYED_WORK(&lcd->marquee_work, LcdMarquee);
+	lcd->client = client;
+	lcd->geo = &lcd_geometries[id ? id->driver_data : LCD_16X2];
+	lcd->minor = -1;
+	i2c_set_clientdata(client, lcd);
+
+	// Screen text, mappable; freed with the last reference as mappings can outlive the device
+	lcd->text = vmalloc_user(PAGE_SIZE);
+	if (!lcd->text) {
+		ret = -ENOMEM;
+		goto err_put;
+	}
+	memset(lcd->text, ' ', LcdCells(lcd));
+
+	ret = LcdInit(lcd);
+	if (ret != 0) {
+		pr_info("LCD not ready/available.\n");
+		goto err_put;
+	}
+	pr_info("LCD is initialized (%ux%u).\n", lcd->geo->cols, lcd->geo->rows);
+
+	lcd->wq = alloc_ordered_workqueue("desd_lcd-%s", 0, dev_name(&client->dev));
+	if (!lcd->wq) {
+		ret = -ENOMEM;
+		goto err_put;
+	}
+
+	mutex_lock(&desd_lcd_idr_lock);
+	ret = idr_alloc(&desd_lcd_idr, lcd, 0, LCD_MAX_PANELS, GFP_KERNEL);
+	mutex_unlock(&desd_lcd_idr_lock);
+	if (ret < 0) {
+		pr_info("idr_alloc() failed.\n");
+		goto err_wq;
+	}
+	lcd->minor = ret;
+	devno = MKDEV(MAJOR(desd_lcd_devno), lcd->minor);
+
+	// init cdev (with fops) and add it in kernel
+	lcd->cdev = cdev_alloc();
+	if (!lcd->cdev) {
+		ret = -ENOMEM;
+		goto err_idr;
+	}
+	lcd->cdev->ops = &desd_lcd_fops;
+	lcd->cdev->owner = THIS_MODULE;
+	ret = cdev_add(lcd->cdev, devno, 1);
+	if (ret < 0) {
+		pr_info("cdev_add() failed.\n");
+		kobject_put(&lcd->cdev->kobj);
+		goto err_idr;
+	}
+	// create device file
+	if (IS_ERR(device_create(desd_lcd_class, &client->dev, devno, lcd, "lcd%d", lcd->minor))) {
+		pr_info("device_create() failed.\n");
+		ret = -ENODEV;
+		goto err_cdev;
+	}
+	pr_info("/dev/lcd%d created.\n", lcd->minor);
+	return 0;
+
+err_cdev:
+	cdev_del(lcd->cdev);
+err_idr:
+	mutex_lock(&desd_lcd_idr_lock);
+	idr_remove(&desd_lcd_idr, lcd->minor);
+	mutex_unlock(&desd_lcd_idr_lock);
+err_wq:
+	destroy_workqueue(lcd->wq);
+err_put:
+	kref_put(&lcd->kref, LcdRelease);
+	return ret;
 }
 
 static int desd_lcd_remove(struct i2c_client *client) {
-    pr_info("lcd Removed!!!\n");
-    // delete cdev from kernel
-    // destroy device file and device class
-    // release device number
-    return 0;
+	struct desd_lcd *lcd = i2c_get_clientdata(client);
+
+	pr_info("lcd%d Removed!!!\n", lcd->minor);
+	// no new opens, then destroy device file and delete cdev from kernel
+	mutex_lock(&desd_lcd_idr_lock);
+	idr_remove(&desd_lcd_idr, lcd->minor);
+	mutex_unlock(&desd_lcd_idr_lock);
+	device_destroy(desd_lcd_class, MKDEV(MAJOR(desd_lcd_devno), lcd->minor));
+	cdev_del(lcd->cdev);
+
+	// Files still open get -ENODEV; whatever was written last reaches the panel
+	mutex_lock(&lcd->text_lock);
+	lcd->gone = true;
+	mutex_unlock(&lcd->text_lock);
+	cancel_delayed_work_sync(&lcd->marquee_work); // before the flush it may queue
+	flush_delayed_work(&lcd->flush_work);
+	cancel_delayed_work_sync(&lcd->flush_work); // a mapped buffer's flush requeues itself
+	destroy_workqueue(lcd->wq);
+
+	pr_info("lcd%d: %lu bytes sent, %lu saved by skipping unchanged characters\n",
+		lcd->minor, lcd->bytes_sent, lcd->bytes_full - lcd->bytes_sent);
+	pr_info("lcd%d: glyphs: %lu cache hits, %lu uploads\n", lcd->minor, lcd->glyph_hits, lcd->glyph_uploads);
+	pr_info("lcd%d: marquee: %lu steps\n", lcd->minor, lcd->mq_steps);
+	kref_put(&lcd->kref, LcdRelease);
+	return 0;
 }
 
 static const struct i2c_device_id desd_lcd_id[] = {
-        { SLAVE_DEVICE_NAME, 0 },
+        { SLAVE_DEVICE_NAME, LCD_16X2 },
+        { "lcd1602", LCD_16X2 },
+        { "lcd2004", LCD_20X4 },
+        { "lcd4002", LCD_40X2 },
         { }
 };
 MODULE_DEVICE_TABLE(i2c, desd_lcd_id);
@@ -150,37 +961,89 @@ static struct i2c_driver desd_lcd_driver = {
         .id_table       = desd_lcd_id,
 };
 
-static struct i2c_board_info lcd_i2c_board_info = {
-    I2C_BOARD_INFO(SLAVE_DEVICE_NAME, LCD_SLAVE_ADDR)
-};
+// Panels to instantiate as "bus:address:type", type being one of desd_lcd_id.
+// The default is the BBB's 16x2 panel: 0x4E >> 1 = 01001110 >> 1 = 00100111 = 0x27
+static char *panels[LCD_MAX_PANELS] = { "2:0x27:" SLAVE_DEVICE_NAME };
+static int npanels = 1;
+module_param_array(panels, charp, &npanels, 0444);
+MODULE_PARM_DESC(panels, "Panels as bus:address:type, type HD44780/lcd1602 (16x2), lcd2004 (20x4) or lcd4002 (40x2)");
+
+static struct i2c_client *desd_i2c_clients[LCD_MAX_PANELS]; // I2C clients created for panels[]
+
+static struct i2c_client *LcdNewClient(const char *spec) {
+	struct i2c_board_info info = { };
+	struct i2c_adapter *adapter;
+	struct i2c_client *client;
+	unsigned int bus;
+	int addr;
+
+	if (sscanf(spec, "%u:%i:%19s", &bus, &addr, info.type) != 3 || addr < 0x03 || addr > 0x77)
+		return ERR_PTR(-EINVAL);
+	info.addr = addr;
+	adapter = i2c_get_adapter(bus);
+	if (!adapter)
+		return ERR_PTR(-ENODEV);
+	client = i2c_new_client_device(adapter, &info);
+	i2c_put_adapter(adapter);
+	return client;
+}
 
 static int __init desd_driver_init(void) {
-    int ret = -1;
-    desd_i2c_adapter = i2c_get_adapter(I2C_BUS_AVAILABLE);
-    if(desd_i2c_adapter != NULL) {
-        //desd_i2c_client_lcd = i2c_new_device(desd_i2c_adapter, &lcd_i2c_board_info);
-        desd_i2c_client_lcd = i2c_new_client_device(desd_i2c_adapter, &lcd_i2c_board_info);
-        if(desd_i2c_client_lcd != NULL) {
-            i2c_add_driver(&desd_lcd_driver);
-            pr_info("Driver Added!!!\n");
-            ret = 0;
-        }
-		else
-            pr_info("lcd client not found!!!\n");
-        
-        i2c_put_adapter(desd_i2c_adapter);
-    }
-	else
-        pr_info("I2C Bus Adapter Not Available!!!\n");
-    return ret;
+	int ret, i, added = 0;
+
+	ret = alloc_chrdev_region(&desd_lcd_devno, 0, LCD_MAX_PANELS, "desd_lcd");
+	if (ret < 0) {
+		pr_info("alloc_chrdev_region() failed.\n");
+		return ret;
+	}
+	desd_lcd_class = class_create(THIS_MODULE, "desd_lcd_class");
+	if (IS_ERR(desd_lcd_class)) {
+		pr_info("class_create() failed.\n");
+		ret = PTR_ERR(desd_lcd_class);
+		goto err_region;
+	}
+	ret = i2c_add_driver(&desd_lcd_driver);
+	if (ret)
+		goto err_class;
+	pr_info("Driver Added!!!\n");
+
+	// The driver probes each panel as its client appears
+	for (i = 0; i < npanels; i++) {
+		desd_i2c_clients[i] = LcdNewClient(panels[i]);
+		if (IS_ERR(desd_i2c_clients[i])) {
+			pr_info("lcd panel %s not added (%ld)!!!\n", panels[i], PTR_ERR(desd_i2c_clients[i]));
+			desd_i2c_clients[i] = NULL;
+			continue;
+		}
+		added++;
+	}
+	if (!added) {
+		pr_info("No lcd panel available!!!\n");
+		ret = -ENODEV;
+		goto err_driver;
+	}
+	return 0;
+
+err_driver:
+	i2c_del_driver(&desd_lcd_driver);
+err_class:
+	class_destroy(desd_lcd_class);
+err_region:
+	unregister_chrdev_region(desd_lcd_devno, LCD_MAX_PANELS);
+	return ret;
 }
 
 static void __exit desd_driver_exit(void) {
-	if(desd_i2c_client_lcd != NULL) {
-        i2c_unregister_device(desd_i2c_client_lcd);
-		i2c_del_driver(&desd_lcd_driver);
-	}
-    pr_info("Driver Removed!!!\n");
+	int i;
+
+	for (i = 0; i < npanels; i++)
+		if (desd_i2c_clients[i])
+			i2c_unregister_device(desd_i2c_clients[i]);
+	i2c_del_driver(&desd_lcd_driver);
+	class_destroy(desd_lcd_class);
+	unregister_chrdev_region(desd_lcd_devno, LCD_MAX_PANELS);
+	idr_destroy(&desd_lcd_idr);
+	pr_info("Driver Removed!!!\n");
 }
 
 module_init(desd_driver_init);
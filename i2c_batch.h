@@ -0,0 +1,101 @@
+/*
+ * Batched I2C transfers shared by the I2C client drivers in this directory
+ * (my_project.c, Lcd_deiver.c, temp-i2c).
+ *
+ * Every i2c_master_send()/i2c_master_recv() is a bus transaction of its own:
+ * adapter lock, START, address byte, data, STOP. A batch collects several
+ * messages and hands them to the adapter with one i2c_transfer(), so they go
+ * out back to back with repeated STARTs in between, a single STOP at the end
+ * and no other master able to get on the bus in the middle.
+ *
+ *     struct i2c_batch b;
+ *
+ *     i2c_batch_init(&b, client);
+ *     i2c_batch_write(&b, cmd, sizeof(cmd));
+ *     i2c_batch_read(&b, val, sizeof(val));
+ *     ret = i2c_batch_run(&b);
+ *
+ * The buffers must stay valid until i2c_batch_run() returns.
+ */
+
+#ifndef I2C_BATCH_H
+#define I2C_BATCH_H
+
+#include <linux/i2c.h>
+#include <linux/errno.h>
+
+// Messages per batch; one more write or read than this makes i2c_batch_run() fail
+#define I2C_BATCH_MAX_MSGS 8
+
+struct i2c_batch
+{
+    struct i2c_client *client;
+    struct i2c_msg msgs[I2C_BATCH_MAX_MSGS];
+    int nmsgs;
+    int err; // first error while building, reported by i2c_batch_run()
+};
+
+static inline void i2c_batch_init(struct i2c_batch *b, struct i2c_client *client)
+{
+    b->client = client;
+    b->nmsgs = 0;
+    b->err = 0;
+}
+
+static inline void i2c_batch_add(struct i2c_batch *b, u16 flags, void *buf, size_t len)
+{
+    struct i2c_msg *msg;
+
+    if (b->nmsgs == I2C_BATCH_MAX_MSGS || len > U16_MAX)
+    {
+        b->err = -EINVAL;
+        return;
+    }
+    msg = &b->msgs[b->nmsgs++];
+    msg->addr = b->client->addr;
+    msg->flags = (b->client->flags & I2C_M_TEN) | flags;
+    msg->len = len;
+    msg->buf = buf;
+}
+
+// Queues a write of len bytes, starting with a repeated START if not the first message
+static inline void i2c_batch_write(struct i2c_batch *b, const void *buf, size_t len)
+{
+    i2c_batch_add(b, 0, (void *)buf, len);
+}
+
+// Queues a read of len bytes
+static inline void i2c_batch_read(struct i2c_batch *b, void *buf, size_t len)
+{
+    i2c_batch_add(b, I2C_M_RD, buf, len);
+}
+
+// Sends all queued messages as one bus transaction; returns 0 or a negative errno
+static inline int i2c_batch_run(struct i2c_batch *b)
+{
+    int ret;
+
+    if (b->err)
+        return b->err;
+    if (!b->nmsgs)
+        return 0;
+    ret = i2c_transfer(b->client->adapter, b->msgs, b->nmsgs);
+    if (ret == b->nmsgs)
+        return 0;
+    return ret < 0 ? ret : -EIO;
+}
+
+// Register burst read: writes the register (or memory) address, then reads
+// len bytes after a repeated START. One transaction instead of a send plus a
+// receive, and nothing can move the device's address pointer in between.
+static inline int i2c_burst_read(struct i2c_client *client, const void *reg, size_t reg_len, void *val, size_t len)
+{
+    struct i2c_batch b;
+
+    i2c_batch_init(&b, client);
+    i2c_batch_write(&b, reg, reg_len);
+    i2c_batch_read(&b, val, len);
+    return i2c_batch_run(&b);
+}
+
+#endif // I2C_BATCH_H
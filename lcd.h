@@ -0,0 +1,86 @@
+/*
+ * HD44780 LCD character device interface shared by the kernel driver
+ * (Lcd_deiver.c) and user space applications.
+ */
+
+#ifndef LCD_H
+#define LCD_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * /dev/lcdN (one per panel) holds the screen text, rows x cols characters
+ * row after row; LCD_IOC_GET_GEOMETRY tells the panel size (16x2, 20x4 or
+ * 40x2). write() and mmap() both change that text; the driver puts it on the
+ * panel refresh_ms (module parameter) later, sending only characters that
+ * differ from what the panel shows.
+ *
+ * mmap() of the first page gives the text itself: modify it in place, then
+ * call LCD_IOC_REFRESH or let the driver pick the change up. While a mapping
+ * exists the driver compares it with the panel every refresh_ms.
+ *
+ *     ioctl(fd, LCD_IOC_GET_GEOMETRY, &geo);
+ *     text = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+ *     memcpy(&text[1 * geo.cols + 10], "42.0C", 5);
+ *     ioctl(fd, LCD_IOC_REFRESH);
+ */
+struct lcd_geometry
+{
+    __u32 rows;
+    __u32 cols;
+};
+
+/*
+ * Custom glyphs: text bytes LCD_GLYPH_FIRST .. LCD_GLYPH_FIRST + LCD_GLYPHS - 1
+ * (blank in the common A00 character ROM) show the glyph defined for them
+ * with LCD_IOC_DEFINE_GLYPH. The driver keeps the glyphs on screen in the
+ * panel's 8 CGRAM slots, uploading one only when it is not there already,
+ * so at most 8 different ones can be shown at a time; cells beyond that and
+ * cells with undefined glyphs show a blank.
+ */
+#define LCD_GLYPH_FIRST 0x10
+#define LCD_GLYPHS 16
+
+struct lcd_glyph
+{
+    __u32 code;    // text byte the glyph is shown for
+    __u8 rows[8];  // 5x8 pixel rows, top first, bit 4 is the leftmost pixel
+};
+
+/*
+ * Marquee: the driver scrolls text across one row by itself, one character
+ * every step_ms (at least 20), until step_ms 0 stops it and the row shows
+ * its file text again; writes to the row meanwhile are kept for then. The
+ * text runs as an endless stream: the text, then blanks, repeating.
+ *
+ * By default each step redraws the row, sending only the cells that change.
+ * With LCD_MARQUEE_SHIFT the text goes into the row's 40 character DDRAM
+ * line once and each step is one display shift instruction, plus one
+ * character when the text is longer than 36. This needs DDRAM beyond the
+ * visible columns on a 2-row panel (16x2). The controller shifts every row,
+ * so the other row moves along with it.
+ *
+ *     struct lcd_marquee mq = { .row = 0, .step_ms = 300, .flags = LCD_MARQUEE_SHIFT };
+ *
+ *     strncpy(mq.text, "Pulse 72 bpm, SpO2 97 %", sizeof(mq.text));
+ *     ioctl(fd, LCD_IOC_MARQUEE, &mq);
+ */
+#define LCD_MARQUEE_MAX 128
+#define LCD_MARQUEE_SHIFT 0x1
+
+struct lcd_marquee
+{
+    __u32 row;
+    __u32 step_ms;               // per character, 0 stops the marquee
+    __u32 flags;                 // LCD_MARQUEE_*
+    char text[LCD_MARQUEE_MAX];  // NUL terminated unless all of it is text
+};
+
+#define LCD_IOC_MAGIC 'L'
+#define LCD_IOC_REFRESH _IO(LCD_IOC_MAGIC, 1) // update the panel now, does not wait for it
+#define LCD_IOC_GET_GEOMETRY _IOR(LCD_IOC_MAGIC, 2, struct lcd_geometry)
+#define LCD_IOC_DEFINE_GLYPH _IOW(LCD_IOC_MAGIC, 3, struct lcd_glyph)
+#define LCD_IOC_MARQUEE _IOW(LCD_IOC_MAGIC, 4, struct lcd_marquee)
+
+#endif // LCD_H
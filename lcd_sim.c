@@ -0,0 +1,627 @@
+// Software HD44780 behind a PCF8574 on a virtual I2C adapter, for testing and
+// benchmarking Lcd_deiver.c without a panel.
+//
+// Like max30100_sim.c, the module registers an I2C adapter whose transfers
+// never leave the machine. Every byte written to the expander sets its eight
+// output pins (RS, RW, EN, backlight, D4-D7). The modelled HD44780 takes
+// D7-D4 on each falling edge of EN, pairs the nibbles once in 4-bit mode and
+// executes the instruction or data write: DDRAM and CGRAM, the address
+// counter, entry mode, display and cursor shift, and the 8-bit to 4-bit
+// switch of the init sequence. Reads with RW and EN high return the busy flag
+// and address counter (or RAM data) on D7-D4.
+//
+// Bytes are timestamped as a bus at bus_khz would deliver them. A nibble that
+// arrives while the previous instruction is still executing is a timing
+// violation; with strict=1 that instruction is lost as on a real panel. One
+// adapter per panel, each with the expander at 0x27:
+//
+//     insmod lcd_sim.ko nr_panels=2 bus_base=20 rows=4 cols=20
+//     insmod Lcd_deiver.ko panels=20:0x27:lcd2004,21:0x27:lcd2004
+//     cat /sys/kernel/debug/lcd_sim/i2c-20/display
+//
+// Next to display, cgram shows the custom glyphs and stats counts transfers,
+// bus bytes, instructions, characters and violations; writing to
+// reset_stats zeroes the counters between benchmark runs.
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/i2c.h>
+#include <linux/delay.h>
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#define SIM_MAX_PANELS 8
+#define SIM_ADDR 0x27 // PCF8574 with A2-A0 high
+
+// PCF8574 pins as wired on the common LCD backpacks
+#define PIN_RS BIT(0)
+#define PIN_RW BIT(1)
+#define PIN_EN BIT(2)
+#define PIN_BL BIT(3)
+
+// HD44780 instructions, by highest set bit
+#define CMD_CLEAR 0x01
+#define CMD_HOME 0x02
+#define CMD_ENTRY 0x04
+#define CMD_CTRL 0x08
+#define CMD_SHIFT 0x10
+#define CMD_FN_SET 0x20
+#define CMD_SET_CGRAM 0x40
+#define CMD_SET_DDRAM 0x80
+
+#define ENTRY_INC BIT(1)
+#define ENTRY_SHIFT BIT(0)
+#define CTRL_DISPLAY BIT(2)
+#define CTRL_CURSOR BIT(1)
+#define CTRL_BLINK BIT(0)
+#define SHIFT_DISPLAY BIT(3)
+#define SHIFT_RIGHT BIT(2)
+#define FN_8BIT BIT(4)
+#define FN_2LINES BIT(3)
+
+#define DDRAM_SIZE 0x80
+#define CGRAM_SIZE 64
+#define LINE2_ADDR 0x40
+
+// Execution times at the nominal 270 kHz oscillator
+#define EXEC_NS 37000
+#define EXEC_DATA_NS 41000 // 37 us, then 4 us until the address counter moves
+#define EXEC_CLEAR_NS 1520000
+#define EXEC_FIRST_FN_SET_NS 4100000 // first 8-bit function set after power up
+#define EXEC_INIT_FN_SET_NS 100000 // later ones while still in 8-bit mode
+#define POWER_UP_NS 15000000 // VCC above 4.5 V until the controller listens
+
+static unsigned int nr_panels = 1;
+module_param(nr_panels, uint, 0444);
+MODULE_PARM_DESC(nr_panels, "Number of simulated panels, one adapter each (1-8)");
+
+static int bus_base = -1;
+module_param(bus_base, int, 0444);
+MODULE_PARM_DESC(bus_base, "Bus number of the first adapter, the rest follow; -1 for dynamic numbers");
+
+static unsigned int rows = 2;
+module_param(rows, uint, 0444);
+MODULE_PARM_DESC(rows, "Visible rows of the display dump (1, 2 or 4)");
+
+static unsigned int cols = 16;
+module_param(cols, uint, 0444);
+MODULE_PARM_DESC(cols, "Visible columns of the display dump");
+
+static unsigned int bus_khz = 100;
+module_param(bus_khz, uint, 0644);
+MODULE_PARM_DESC(bus_khz, "Emulated I2C clock for byte timestamps and transfer times, 0 for instant transfers without timing checks");
+
+static unsigned int exec_pct = 100;
+module_param(exec_pct, uint, 0644);
+MODULE_PARM_DESC(exec_pct, "Instruction execution times in % of the datasheet's (142 for a 190 kHz oscillator)");
+
+static bool strict = true;
+module_param(strict, bool, 0644);
+MODULE_PARM_DESC(strict, "Drop instructions that arrive while the controller is busy");
+
+struct lcd_sim
+{
+    struct i2c_adapter adap;
+    struct mutex lock;
+    struct dentry *debugfs;
+
+    // PCF8574
+    u8 pins; // outputs as last written
+    u64 bus_ns; // when the last transfer ended on the emulated bus
+
+    // HD44780
+    u8 ddram[DDRAM_SIZE];
+    u8 cgram[CGRAM_SIZE];
+    u8 ac; // address counter
+    bool cg; // ac points into CGRAM
+    bool bus8; // 8-bit interface, until a function set selects 4-bit
+    bool two_lines;
+    bool low_nibble; // 4-bit mode: the high nibble has been taken
+    u8 high; // that high nibble
+    bool early; // a nibble of the current byte arrived while busy
+    u8 entry;
+    u8 ctrl;
+    unsigned int shift; // display shift, characters to the left
+    unsigned int fn_sets; // function sets since power up
+    u64 busy_until_ns;
+
+    // Counters
+    u64 xfers;
+    u64 bytes;
+    u64 instructions;
+    u64 chars;
+    u64 cgram_writes;
+    u64 busy_reads;
+    u64 violations;
+    u64 worst_early_ns;
+};
+
+static struct lcd_sim *sim_panels[SIM_MAX_PANELS];
+static struct dentry *sim_debugfs_root;
+
+// Internal reset at power up: 8-bit interface, 1 line, display off, DDRAM blank
+static void sim_power_on(struct lcd_sim *sim)
+{
+    memset(sim->ddram, ' ', sizeof(sim->ddram));
+    memset(sim->cgram, 0, sizeof(sim->cgram));
+    sim->pins = 0xFF; // PCF8574 outputs come up high
+    sim->ac = 0;
+    sim->cg = false;
+    sim->bus8 = true;
+    sim->two_lines = false;
+    sim->low_nibble = false;
+    sim->early = false;
+    sim->entry = ENTRY_INC;
+    sim->ctrl = 0;
+    sim->shift = 0;
+    sim->fn_sets = 0;
+    sim->busy_until_ns = ktime_get_ns() + POWER_UP_NS;
+}
+
+static unsigned int sim_line_len(struct lcd_sim *sim)
+{
+    return sim->two_lines ? 40 : 80;
+}
+
+// How long the controller stays busy after rs/val
+static u64 sim_exec_ns(struct lcd_sim *sim, bool rs, u8 val)
+{
+    u64 ns = EXEC_NS;
+
+    if (rs)
+        ns = EXEC_DATA_NS;
+    else if (val == CMD_CLEAR || (val & ~1) == CMD_HOME)
+        ns = EXEC_CLEAR_NS;
+    else if ((val & 0xE0) == CMD_FN_SET && sim->bus8)
+        ns = sim->fn_sets == 1 ? EXEC_FIRST_FN_SET_NS : EXEC_INIT_FN_SET_NS;
+    return div_u64(ns * READ_ONCE(exec_pct), 100);
+}
+
+// Moves the address counter one step like the controller: CGRAM wraps at 64,
+// DDRAM in 2-line mode runs 0x00-0x27 and then 0x40-0x67
+static void sim_ac_step(struct lcd_sim *sim, bool inc)
+{
+    if (sim->cg)
+        sim->ac = (sim->ac + (inc ? 1 : -1)) & (CGRAM_SIZE - 1);
+    else if (!sim->two_lines)
+        sim->ac = inc ? (sim->ac + 1) % 80 : (sim->ac + 79) % 80;
+    else if (inc)
+        sim->ac = sim->ac == 0x27 ? LINE2_ADDR : sim->ac == 0x67 ? 0x00 : sim->ac + 1;
+    else
+        sim->ac = sim->ac == LINE2_ADDR ? 0x27 : sim->ac == 0x00 ? 0x67 : sim->ac - 1;
+}
+
+static void sim_shift_display(struct lcd_sim *sim, bool left)
+{
+    unsigned int len = sim_line_len(sim);
+
+    sim->shift = (sim->shift + (left ? 1 : len - 1)) % len;
+}
+
+static void sim_execute(struct lcd_sim *sim, bool rs, u8 val)
+{
+    if (rs)
+    {
+        if (sim->cg)
+        {
+            sim->cgram[sim->ac & (CGRAM_SIZE - 1)] = val & 0x1F;
+            sim->cgram_writes++;
+        }
+        else
+        {
+            sim->ddram[sim->ac & (DDRAM_SIZE - 1)] = val;
+            sim->chars++;
+            if (sim->entry & ENTRY_SHIFT)
+                sim_shift_display(sim, sim->entry & ENTRY_INC);
+        }
+        sim_ac_step(sim, sim->entry & ENTRY_INC);
+        return;
+    }
+
+    sim->instructions++;
+    if (val & CMD_SET_DDRAM)
+    {
+        sim->ac = val & (DDRAM_SIZE - 1);
+        sim->cg = false;
+    }
+    else if (val & CMD_SET_CGRAM)
+    {
+        sim->ac = val & (CGRAM_SIZE - 1);
+        sim->cg = true;
+    }
+    else if (val & CMD_FN_SET)
+    {
+        sim->bus8 = val & FN_8BIT;
+        sim->two_lines = val & FN_2LINES;
+        sim->shift %= sim_line_len(sim);
+    }
+    else if (val & CMD_SHIFT)
+    {
+        if (val & SHIFT_DISPLAY)
+            sim_shift_display(sim, !(val & SHIFT_RIGHT));
+        else
+            sim_ac_step(sim, val & SHIFT_RIGHT);
+    }
+    else if (val & CMD_CTRL)
+        sim->ctrl = val & 0x07;
+    else if (val & CMD_ENTRY)
+        sim->entry = val & 0x03;
+    else if (val & (CMD_HOME | CMD_CLEAR))
+    {
+        if (val & CMD_CLEAR)
+        {
+            memset(sim->ddram, ' ', sizeof(sim->ddram));
+            sim->entry |= ENTRY_INC;
+        }
+        sim->ac = 0;
+        sim->cg = false;
+        sim->shift = 0;
+    }
+}
+
+// A nibble written while the controller is still busy
+static void sim_check_timing(struct lcd_sim *sim, u8 pins, u64 t_ns)
+{
+    u64 early;
+
+    if (!READ_ONCE(bus_khz) || t_ns >= sim->busy_until_ns || sim->early)
+        return;
+    early = sim->busy_until_ns - t_ns;
+    sim->early = true;
+    sim->violations++;
+    sim->worst_early_ns = max(sim->worst_early_ns, early);
+    pr_warn_ratelimited("LCD sim %s: %s nibble 0x%x %llu ns early\n", dev_name(&sim->adap.dev),
+                        pins & PIN_RS ? "data" : "instruction", pins >> 4, early);
+}
+
+// A complete byte for the controller, taken at t_ns
+static void sim_byte(struct lcd_sim *sim, bool rs, u8 val, u64 t_ns)
+{
+    if (sim->early)
+    {
+        sim->early = false;
+        if (READ_ONCE(strict))
+            return; // the controller ignores what comes while it is busy
+    }
+    if (!rs && (val & 0xE0) == CMD_FN_SET)
+        sim->fn_sets++;
+    sim->busy_until_ns = t_ns + sim_exec_ns(sim, rs, val);
+    sim_execute(sim, rs, val);
+}
+
+// Falling edge of EN with pins as they were while it was high: the
+// controller takes D7-D4 of a write, or ends a read cycle
+static void sim_en_fall(struct lcd_sim *sim, u8 pins, u64 t_ns)
+{
+    bool rs = pins & PIN_RS;
+    u8 d = pins >> 4;
+
+    if (pins & PIN_RW)
+    {
+        // Reading data moves the address counter once the byte is out
+        if (rs && (sim->bus8 || sim->low_nibble))
+            sim_ac_step(sim, sim->entry & ENTRY_INC);
+        if (!sim->bus8)
+            sim->low_nibble = !sim->low_nibble;
+        return;
+    }
+
+    sim_check_timing(sim, pins, t_ns);
+    if (sim->bus8)
+    {
+        // D3-D0 are not wired; the controller's pull-ups make them 1
+        sim_byte(sim, rs, d << 4 | 0x0F, t_ns);
+        return;
+    }
+    if (!sim->low_nibble)
+    {
+        sim->high = d;
+        sim->low_nibble = true;
+        return;
+    }
+    sim->low_nibble = false;
+    sim_byte(sim, rs, sim->high << 4 | d, t_ns);
+}
+
+static void sim_write_pins(struct lcd_sim *sim, u8 pins, u64 t_ns)
+{
+    u8 old = sim->pins;
+
+    sim->pins = pins;
+    if ((old & PIN_EN) && !(pins & PIN_EN))
+        sim_en_fall(sim, old, t_ns);
+}
+
+// Reading the PCF8574 returns its pins: outputs written low read low, the
+// rest are weak pull-ups the controller pulls down while it drives D7-D4
+static u8 sim_read_pins(struct lcd_sim *sim, u64 t_ns)
+{
+    u8 pins = sim->pins;
+    u8 val;
+
+    if ((pins & (PIN_RW | PIN_EN)) != (PIN_RW | PIN_EN))
+        return pins;
+
+    if (pins & PIN_RS)
+    {
+        val = sim->cg ? sim->cgram[sim->ac & (CGRAM_SIZE - 1)] : sim->ddram[sim->ac & (DDRAM_SIZE - 1)];
+    }
+    else
+    {
+        val = (t_ns < sim->busy_until_ns ? 0x80 : 0) | (sim->ac & 0x7F);
+        if (!sim->low_nibble)
+            sim->busy_reads++;
+    }
+    val = sim->low_nibble ? val << 4 : val;
+    return pins & ((val & 0xF0) | 0x0F);
+}
+
+// Time the transfer would take on a real bus: 9 clocks per byte plus the address byte
+static void sim_bus_delay(unsigned int bytes)
+{
+    unsigned int khz = READ_ONCE(bus_khz);
+    unsigned long us;
+
+    if (!khz)
+        return;
+    us = DIV_ROUND_UP(bytes * 9 * 1000, khz);
+    if (us < 10)
+        udelay(us);
+    else
+        usleep_range(us, us + us / 8);
+}
+
+static int sim_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+    struct lcd_sim *sim = i2c_get_adapdata(adap);
+    unsigned int khz = READ_ONCE(bus_khz);
+    u64 byte_ns = khz ? 9 * NSEC_PER_MSEC / khz : 0;
+    unsigned int bytes = 0;
+    u64 t;
+    int i, j;
+
+    mutex_lock(&sim->lock);
+    // Each byte takes effect when it has crossed the bus, back to back
+    // within the transfer and not before the previous transfer ended
+    t = max(ktime_get_ns(), sim->bus_ns);
+    for (i = 0; i < num; i++)
+    {
+        struct i2c_msg *msg = &msgs[i];
+
+        if (msg->addr != SIM_ADDR)
+        {
+            mutex_unlock(&sim->lock);
+            return -ENXIO;
+        }
+        bytes += msg->len + 1;
+        t += byte_ns; // address byte
+
+        for (j = 0; j < msg->len; j++)
+        {
+            t += byte_ns;
+            if (msg->flags & I2C_M_RD)
+                msg->buf[j] = sim_read_pins(sim, t);
+            else
+                sim_write_pins(sim, msg->buf[j], t);
+        }
+    }
+    sim->bus_ns = t;
+    sim->xfers++;
+    sim->bytes += bytes;
+    mutex_unlock(&sim->lock);
+
+    sim_bus_delay(bytes);
+    return num;
+}
+
+static u32 sim_func(struct i2c_adapter *adap)
+{
+    return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm sim_algorithm = {
+    .master_xfer = sim_xfer,
+    .functionality = sim_func,
+};
+
+// The visible text, rows x cols: in 2-line mode row r shows DDRAM line r % 2
+// from column (r / 2) * cols on, moved by the display shift. Characters
+// outside printable ASCII, custom glyphs included, show as '?'.
+static int sim_display_show(struct seq_file *s, void *unused)
+{
+    struct lcd_sim *sim = s->private;
+    unsigned int len, r, c, line, col;
+    u8 ch;
+
+    mutex_lock(&sim->lock);
+    len = sim_line_len(sim);
+    seq_putc(s, '+');
+    for (c = 0; c < cols; c++)
+        seq_putc(s, '-');
+    seq_puts(s, "+\n");
+    for (r = 0; r < rows; r++)
+    {
+        line = sim->two_lines ? r & 1 : 0;
+        seq_putc(s, '|');
+        for (c = 0; c < cols; c++)
+        {
+            col = ((sim->two_lines ? r >> 1 : r) * cols + c + sim->shift) % len;
+            ch = sim->ddram[line * LINE2_ADDR + col];
+            seq_putc(s, ch >= 0x20 && ch < 0x7F ? ch : '?');
+        }
+        seq_puts(s, "|\n");
+    }
+    seq_putc(s, '+');
+    for (c = 0; c < cols; c++)
+        seq_putc(s, '-');
+    seq_puts(s, "+\n");
+    seq_printf(s, "display %s, cursor %s, blink %s, backlight %s, %s interface, %u line%s, shift %u, %s address 0x%02x\n",
+               sim->ctrl & CTRL_DISPLAY ? "on" : "off", sim->ctrl & CTRL_CURSOR ? "on" : "off",
+               sim->ctrl & CTRL_BLINK ? "on" : "off", sim->pins & PIN_BL ? "on" : "off",
+               sim->bus8 ? "8-bit" : "4-bit", sim->two_lines ? 2 : 1, sim->two_lines ? "s" : "", sim->shift,
+               sim->cg ? "CGRAM" : "DDRAM", sim->ac);
+    mutex_unlock(&sim->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sim_display);
+
+// The 8 custom glyphs side by side, 5x8 pixels each
+static int sim_cgram_show(struct seq_file *s, void *unused)
+{
+    struct lcd_sim *sim = s->private;
+    unsigned int g, row, bit;
+
+    mutex_lock(&sim->lock);
+    for (row = 0; row < 8; row++)
+    {
+        for (g = 0; g < CGRAM_SIZE / 8; g++)
+        {
+            for (bit = 5; bit--;)
+                seq_putc(s, sim->cgram[g * 8 + row] & BIT(bit) ? '#' : '.');
+            seq_putc(s, g + 1 < CGRAM_SIZE / 8 ? ' ' : '\n');
+        }
+    }
+    mutex_unlock(&sim->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sim_cgram);
+
+static int sim_stats_show(struct seq_file *s, void *unused)
+{
+    struct lcd_sim *sim = s->private;
+
+    mutex_lock(&sim->lock);
+    seq_printf(s, "transfers: %llu\n", sim->xfers);
+    seq_printf(s, "bus_bytes: %llu\n", sim->bytes);
+    seq_printf(s, "instructions: %llu\n", sim->instructions);
+    seq_printf(s, "ddram_writes: %llu\n", sim->chars);
+    seq_printf(s, "cgram_writes: %llu\n", sim->cgram_writes);
+    seq_printf(s, "busy_reads: %llu\n", sim->busy_reads);
+    seq_printf(s, "violations: %llu\n", sim->violations);
+    seq_printf(s, "worst_early_ns: %llu\n", sim->worst_early_ns);
+    mutex_unlock(&sim->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sim_stats);
+
+// Writing anything zeroes the counters, e.g. between benchmark runs
+static ssize_t sim_reset_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+    struct lcd_sim *sim = file->private_data;
+
+    mutex_lock(&sim->lock);
+    sim->xfers = 0;
+    sim->bytes = 0;
+    sim->instructions = 0;
+    sim->chars = 0;
+    sim->cgram_writes = 0;
+    sim->busy_reads = 0;
+    sim->violations = 0;
+    sim->worst_early_ns = 0;
+    mutex_unlock(&sim->lock);
+    return count;
+}
+
+static const struct file_operations sim_reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = sim_reset_write,
+    .llseek = noop_llseek,
+};
+
+static struct lcd_sim *sim_create(unsigned int index)
+{
+    struct lcd_sim *sim;
+    int ret;
+
+    sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+    if (!sim)
+        return ERR_PTR(-ENOMEM);
+
+    mutex_init(&sim->lock);
+    sim_power_on(sim);
+
+    sim->adap.owner = THIS_MODULE;
+    sim->adap.algo = &sim_algorithm;
+    snprintf(sim->adap.name, sizeof(sim->adap.name), "HD44780 simulator %u", index);
+    i2c_set_adapdata(&sim->adap, sim);
+
+    if (bus_base >= 0)
+    {
+        sim->adap.nr = bus_base + index;
+        ret = i2c_add_numbered_adapter(&sim->adap);
+    }
+    else
+        ret = i2c_add_adapter(&sim->adap);
+    if (ret)
+    {
+        kfree(sim);
+        return ERR_PTR(ret);
+    }
+
+    sim->debugfs = debugfs_create_dir(dev_name(&sim->adap.dev), sim_debugfs_root);
+    debugfs_create_file("display", 0444, sim->debugfs, sim, &sim_display_fops);
+    debugfs_create_file("cgram", 0444, sim->debugfs, sim, &sim_cgram_fops);
+    debugfs_create_file("stats", 0444, sim->debugfs, sim, &sim_stats_fops);
+    debugfs_create_file("reset_stats", 0200, sim->debugfs, sim, &sim_reset_fops);
+
+    pr_info("LCD sim: %s at 0x%02x, %ux%u\n", dev_name(&sim->adap.dev), SIM_ADDR, cols, rows);
+    return sim;
+}
+
+static void sim_destroy(struct lcd_sim *sim)
+{
+    debugfs_remove_recursive(sim->debugfs);
+    i2c_del_adapter(&sim->adap);
+    kfree(sim);
+}
+
+static int __init lcd_sim_init(void)
+{
+    unsigned int i;
+
+    if (nr_panels < 1 || nr_panels > SIM_MAX_PANELS)
+        return -EINVAL;
+    // 4 rows share the two 40 character DDRAM lines
+    if ((rows != 1 && rows != 2 && rows != 4) || !cols || cols * (rows == 4 ? 2 : 1) > 40)
+        return -EINVAL;
+
+    sim_debugfs_root = debugfs_create_dir("lcd_sim", NULL);
+    for (i = 0; i < nr_panels; i++)
+    {
+        sim_panels[i] = sim_create(i);
+        if (IS_ERR(sim_panels[i]))
+        {
+            int ret = PTR_ERR(sim_panels[i]);
+
+            sim_panels[i] = NULL;
+            while (i--)
+                sim_destroy(sim_panels[i]);
+            debugfs_remove_recursive(sim_debugfs_root);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void __exit lcd_sim_exit(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr_panels; i++)
+        if (sim_panels[i])
+            sim_destroy(sim_panels[i]);
+    debugfs_remove_recursive(sim_debugfs_root);
+}
+
+module_init(lcd_sim_init);
+module_exit(lcd_sim_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Varad Kalekar ");
+MODULE_DESCRIPTION("Simulated HD44780 LCD behind a PCF8574 on a virtual I2C adapter");
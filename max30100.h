@@ -0,0 +1,86 @@
+/*
+ * MAX30100 character device interface shared by the kernel driver
+ * (my_project.c) and user space applications.
+ */
+
+#ifndef MAX30100_H
+#define MAX30100_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// read() formats, selected per open file with MAX30100_IOC_SET_FORMAT
+#define MAX30100_FMT_TEXT 0   // "ir red\n" lines (default)
+#define MAX30100_FMT_BINARY 1 // array of struct max30100_record
+
+// One sample as returned by read() in binary mode (16 bytes, no padding)
+struct max30100_record
+{
+    __u64 timestamp_ns; // CLOCK_MONOTONIC time the chip took the sample, reconstructed
+                        // from the interrupt or drain time and the sample period
+    __u16 ir;
+    __u16 red;
+    __u16 flags; // MAX30100_REC_*
+    __s16 temp;  // die temperature in 1/16 degC, valid with MAX30100_REC_TEMP
+};
+
+// Record flags
+#define MAX30100_REC_GAP 0x0001  // samples were lost right before this one
+#define MAX30100_REC_TEMP 0x0002 // temp holds the latest die temperature reading
+
+/*
+ * mmap() layout: a control page followed by ctrl->slots records starting at
+ * ctrl->data_offset. The driver advances head, the (single) consumer advances
+ * tail; both are free running and index the ring modulo slots:
+ *
+ *     tail = ctrl->tail;
+ *     while (tail != __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE))
+ *         consume(&records[tail++ & (ctrl->slots - 1)]);
+ *     __atomic_store_n(&ctrl->tail, tail, __ATOMIC_RELEASE);
+ *
+ * poll() reports EPOLLIN while head != tail. While the ring is mapped new
+ * samples go to the ring only, not to read().
+ */
+struct max30100_ring_ctrl
+{
+    __u32 head;        // next slot the driver fills
+    __u32 tail;        // next slot user space consumes
+    __u32 slots;       // ring size in records, a power of 2
+    __u32 data_offset; // byte offset of the first record in the mapping
+    __u32 overruns;    // records dropped because the ring was full
+};
+
+#define MAX30100_RING_SLOTS 1024
+
+// Measurement modes (MODE_CONFIG[2:0])
+#define MAX30100_MODE_HR 0x02   // IR LED only, red samples read as 0
+#define MAX30100_MODE_SPO2 0x03 // IR and red LEDs
+
+/*
+ * Measurement settings. Only datasheet values are accepted:
+ *   sample_rate_hz: 50, 100, 167, 200, 400, 600, 800, 1000
+ *   pulse_width_us: 200, 400, 800, 1600 (the longest widths are limited at
+ *                   high sample rates, see the MAX30100 datasheet tables 8/9)
+ *   *_current_ua:   0, 4400, 7600, 11000, 14200, 17400, 20800, 24000, 27100,
+ *                   30600, 33800, 37000, 40200, 43600, 46800, 50000
+ *   temp_period_ms: 0 (no temperature sampling) or 100 - 60000; conversions
+ *                   are started and read back during FIFO drains, so the
+ *                   effective period is rounded up to the drain interval
+ */
+struct max30100_config
+{
+    __u32 mode;
+    __u32 sample_rate_hz;
+    __u32 pulse_width_us;
+    __u32 ir_current_ua;
+    __u32 red_current_ua;
+    __u32 temp_period_ms;
+};
+
+#define MAX30100_IOC_MAGIC 'M'
+#define MAX30100_IOC_SET_FORMAT _IOW(MAX30100_IOC_MAGIC, 1, int)
+#define MAX30100_IOC_GET_FORMAT _IOR(MAX30100_IOC_MAGIC, 2, int)
+#define MAX30100_IOC_SET_CONFIG _IOW(MAX30100_IOC_MAGIC, 3, struct max30100_config)
+#define MAX30100_IOC_GET_CONFIG _IOR(MAX30100_IOC_MAGIC, 4, struct max30100_config)
+
+#endif // MAX30100_H
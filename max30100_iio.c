@@ -0,0 +1,402 @@
+// IIO variant of the MAX30100 driver (see my_project.c for the /dev/max30100-N char devices).
+// Exposes in_intensity_ir and in_intensity_red as buffered channels with a
+// per-sample timestamp. Samples are streamed from the chip FIFO on the INT line.
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/i2c.h>
+#include <linux/delay.h>
+#include <linux/kernel.h>
+#include <linux/of.h>
+#include <linux/interrupt.h>
+#include <linux/mutex.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/iio/sysfs.h>
+
+#define I2C_SLAVE_NAME "max30100"
+
+// Register definitions
+#define REG_INT_STATUS 0x00
+#define REG_INT_ENABLE 0x01
+#define REG_FIFO_WR_PTR 0x02
+#define REG_OVF_COUNTER 0x03
+#define REG_FIFO_RD_PTR 0x04
+#define REG_FIFO_DATA 0x05
+#define REG_MODE_CONFIG 0x06
+#define REG_SPO2_CONFIG 0x07
+#define REG_LED_CONFIG 0x09
+
+// Interrupt status/enable bits
+#define INT_A_FULL BIT(7)
+#define INT_SPO2_RDY BIT(4)
+#define INT_PWR_RDY BIT(0)
+
+#define MODE_SHDN BIT(7)
+#define MODE_SPO2 0x03
+#define SPO2_CONFIG_DEFAULT 0x47 // high resolution, 100Hz sample rate, 1600us pulse width
+#define LED_CONFIG_DEFAULT 0x77  // IR=24mA, Red=24mA
+#define SAMPLE_RATE_HZ 100
+
+// Chip FIFO holds 16 samples of 4 bytes (IR msb/lsb, Red msb/lsb)
+#define FIFO_DEPTH 16
+#define FIFO_SAMPLE_SIZE 4
+#define FIFO_A_FULL 15 // A_FULL fires with 15 unread samples, fixed in silicon
+
+struct max30100_iio_data
+{
+    struct i2c_client *client;
+    struct mutex lock;      // serialises FIFO drains and interrupt setup
+    unsigned int watermark; // samples per FIFO drain, 1..FIFO_A_FULL
+    s64 irq_timestamp;      // time the INT line fired
+    u8 fifo_buf[FIFO_DEPTH * FIFO_SAMPLE_SIZE];
+    struct
+    {
+        __be16 channels[2];
+        s64 ts __aligned(8);
+    } scan;
+};
+
+static const struct iio_chan_spec max30100_iio_channels[] = {
+    {
+        .type = IIO_INTENSITY,
+        .modified = 1,
+        .channel2 = IIO_MOD_LIGHT_IR,
+        .info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .scan_index = 0,
+        .scan_type = {
+            .sign = 'u',
+            .realbits = 16,
+            .storagebits = 16,
+            .endianness = IIO_BE,
+        },
+    },
+    {
+        .type = IIO_INTENSITY,
+        .modified = 1,
+        .channel2 = IIO_MOD_LIGHT_RED,
+        .info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .scan_index = 1,
+        .scan_type = {
+            .sign = 'u',
+            .realbits = 16,
+            .storagebits = 16,
+            .endianness = IIO_BE,
+        },
+    },
+    IIO_CHAN_SOFT_TIMESTAMP(2),
+};
+
+// Every drain pushes both channels; the core picks out the enabled ones
+static const unsigned long max30100_iio_scan_masks[] = {0x3, 0};
+
+// Empties the chip FIFO so the pointers start from a known state
+static int max30100_iio_fifo_reset(struct max30100_iio_data *data)
+{
+    int ret;
+
+    ret = i2c_smbus_write_byte_data(data->client, REG_FIFO_WR_PTR, 0);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_OVF_COUNTER, 0);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_FIFO_RD_PTR, 0);
+    return ret;
+}
+
+// A watermark below A_FULL needs the per-sample SPO2_RDY interrupt to be seen
+static int max30100_iio_set_interrupts(struct max30100_iio_data *data)
+{
+    u8 enable = INT_A_FULL;
+
+    if (data->watermark < FIFO_A_FULL)
+        enable |= INT_SPO2_RDY;
+    return i2c_smbus_write_byte_data(data->client, REG_INT_ENABLE, enable);
+}
+
+// Returns the number of unread samples in the chip FIFO. Equal pointers mean an empty FIFO
+// or one holding FIFO_DEPTH samples; a_full (A_FULL seen in INT_STATUS) tells it is the latter.
+static int max30100_iio_fifo_count(struct max30100_iio_data *data, bool a_full)
+{
+    u8 ptrs[3]; // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR
+    int count, ret;
+
+    ret = i2c_smbus_read_i2c_block_data(data->client, REG_FIFO_WR_PTR, sizeof(ptrs), ptrs);
+    if (ret < 0)
+        return ret;
+    if (ret != sizeof(ptrs))
+        return -EIO;
+
+    // A non-zero overflow counter means the FIFO is full and samples were lost
+    if (ptrs[1])
+        return FIFO_DEPTH;
+    count = (ptrs[0] - ptrs[2]) & (FIFO_DEPTH - 1);
+    return count == 0 && a_full ? FIFO_DEPTH : count;
+}
+
+// Burst reads count samples and pushes them with timestamps spaced one sample period apart
+static int max30100_iio_drain(struct iio_dev *indio_dev, int count)
+{
+    struct max30100_iio_data *data = iio_priv(indio_dev);
+    s64 period = NSEC_PER_SEC / SAMPLE_RATE_HZ;
+    int ret, i;
+
+    // Use a combined I2C transfer to write the register address and then read the samples
+    struct i2c_msg msgs[2] = {
+        {
+            .addr = data->client->addr,
+            .flags = 0, // Write
+            .len = 1,
+            .buf = (u8[]){REG_FIFO_DATA},
+        },
+        {
+            .addr = data->client->addr,
+            .flags = I2C_M_RD, // Read
+            .len = count * FIFO_SAMPLE_SIZE,
+            .buf = data->fifo_buf,
+        },
+    };
+
+    ret = i2c_transfer(data->client->adapter, msgs, 2);
+    if (ret != 2)
+        return ret < 0 ? ret : -EIO;
+
+    // The newest sample was taken when the interrupt fired
+    for (i = 0; i < count; i++)
+    {
+        memcpy(data->scan.channels, &data->fifo_buf[i * FIFO_SAMPLE_SIZE], sizeof(data->scan.channels));
+        iio_push_to_buffers_with_timestamp(indio_dev, &data->scan,
+                                           data->irq_timestamp - (count - 1 - i) * period);
+    }
+    return count;
+}
+
+static irqreturn_t max30100_iio_irq_handler(int irq, void *private)
+{
+    struct iio_dev *indio_dev = private;
+    struct max30100_iio_data *data = iio_priv(indio_dev);
+
+    data->irq_timestamp = iio_get_time_ns(indio_dev);
+    return IRQ_WAKE_THREAD;
+}
+
+// Reading INT_STATUS acknowledges the interrupt
+static irqreturn_t max30100_iio_irq_thread(int irq, void *private)
+{
+    struct iio_dev *indio_dev = private;
+    struct max30100_iio_data *data = iio_priv(indio_dev);
+    int status, count;
+
+    status = i2c_smbus_read_byte_data(data->client, REG_INT_STATUS);
+    if (status < 0 || !(status & (INT_A_FULL | INT_SPO2_RDY)))
+        return IRQ_NONE;
+
+    mutex_lock(&data->lock);
+    count = max30100_iio_fifo_count(data, status & INT_A_FULL);
+    if (count > 0 && (count >= data->watermark || (status & INT_A_FULL)))
+        max30100_iio_drain(indio_dev, count);
+    mutex_unlock(&data->lock);
+
+    return IRQ_HANDLED;
+}
+
+static int max30100_iio_buffer_postenable(struct iio_dev *indio_dev)
+{
+    struct max30100_iio_data *data = iio_priv(indio_dev);
+    int ret;
+
+    mutex_lock(&data->lock);
+    ret = max30100_iio_fifo_reset(data);
+    if (ret == 0)
+        ret = max30100_iio_set_interrupts(data);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_MODE_CONFIG, MODE_SPO2);
+    mutex_unlock(&data->lock);
+    return ret;
+}
+
+static int max30100_iio_buffer_predisable(struct iio_dev *indio_dev)
+{
+    struct max30100_iio_data *data = iio_priv(indio_dev);
+    int ret;
+
+    mutex_lock(&data->lock);
+    ret = i2c_smbus_write_byte_data(data->client, REG_INT_ENABLE, 0);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_MODE_CONFIG, MODE_SHDN | MODE_SPO2);
+    mutex_unlock(&data->lock);
+    return ret;
+}
+
+static const struct iio_buffer_setup_ops max30100_iio_buffer_ops = {
+    .postenable = max30100_iio_buffer_postenable,
+    .predisable = max30100_iio_buffer_predisable,
+};
+
+static int max30100_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                                 int *val, int *val2, long mask)
+{
+    switch (mask)
+    {
+    case IIO_CHAN_INFO_SAMP_FREQ:
+        *val = SAMPLE_RATE_HZ;
+        return IIO_VAL_INT;
+    default:
+        return -EINVAL;
+    }
+}
+
+// Called by the IIO core with min(buffer watermark, hwfifo_watermark_max)
+static int max30100_iio_set_watermark(struct iio_dev *indio_dev, unsigned int val)
+{
+    struct max30100_iio_data *data = iio_priv(indio_dev);
+    int ret = 0;
+
+    mutex_lock(&data->lock);
+    data->watermark = clamp_t(unsigned int, val, 1, FIFO_A_FULL);
+    if (iio_buffer_enabled(indio_dev))
+        ret = max30100_iio_set_interrupts(data);
+    mutex_unlock(&data->lock);
+    return ret;
+}
+
+static ssize_t hwfifo_watermark_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct max30100_iio_data *data = iio_priv(dev_to_iio_dev(dev));
+
+    return sysfs_emit(buf, "%u\n", data->watermark);
+}
+
+static IIO_DEVICE_ATTR_RO(hwfifo_watermark, 0);
+static IIO_CONST_ATTR(hwfifo_watermark_min, "1");
+static IIO_CONST_ATTR(hwfifo_watermark_max, __stringify(FIFO_A_FULL));
+static IIO_CONST_ATTR(hwfifo_enabled, "1");
+
+static const struct attribute *max30100_iio_fifo_attrs[] = {
+    &iio_dev_attr_hwfifo_watermark.dev_attr.attr,
+    &iio_const_attr_hwfifo_watermark_min.dev_attr.attr,
+    &iio_const_attr_hwfifo_watermark_max.dev_attr.attr,
+    &iio_const_attr_hwfifo_enabled.dev_attr.attr,
+    NULL,
+};
+
+static const struct iio_info max30100_iio_info = {
+    .read_raw = max30100_iio_read_raw,
+    .hwfifo_set_watermark = max30100_iio_set_watermark,
+};
+
+// Waits for PWR_RDY and programs the measurement settings; the chip stays
+// in shutdown until the buffer is enabled
+static int max30100_iio_chip_init(struct max30100_iio_data *data)
+{
+    int status;
+    int retries = 10;
+    int ret;
+
+    while (retries--)
+    {
+        status = i2c_smbus_read_byte_data(data->client, REG_INT_STATUS);
+        if (status < 0)
+            return status;
+        if (status & INT_PWR_RDY)
+            break;
+        msleep(100);
+    }
+    if (!(status & INT_PWR_RDY))
+    {
+        dev_err(&data->client->dev, "PWR_RDY not set\n");
+        return -ENODEV;
+    }
+
+    ret = i2c_smbus_write_byte_data(data->client, REG_MODE_CONFIG, MODE_SHDN | MODE_SPO2);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_SPO2_CONFIG, SPO2_CONFIG_DEFAULT);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_LED_CONFIG, LED_CONFIG_DEFAULT);
+    if (ret == 0)
+        ret = i2c_smbus_write_byte_data(data->client, REG_INT_ENABLE, 0);
+    return ret;
+}
+
+static void max30100_iio_shutdown(void *private)
+{
+    struct max30100_iio_data *data = private;
+
+    i2c_smbus_write_byte_data(data->client, REG_INT_ENABLE, 0);
+    i2c_smbus_write_byte_data(data->client, REG_MODE_CONFIG, MODE_SHDN | MODE_SPO2);
+}
+
+static int max30100_iio_probe(struct i2c_client *client, const struct i2c_device_id *id)
+{
+    struct iio_dev *indio_dev;
+    struct max30100_iio_data *data;
+    int ret;
+
+    if (client->irq <= 0)
+        return dev_err_probe(&client->dev, -EINVAL, "INT line is required for buffered mode\n");
+
+    indio_dev = devm_iio_device_alloc(&client->dev, sizeof(*data));
+    if (!indio_dev)
+        return -ENOMEM;
+
+    data = iio_priv(indio_dev);
+    data->client = client;
+    data->watermark = FIFO_A_FULL;
+    mutex_init(&data->lock);
+    i2c_set_clientdata(client, indio_dev);
+
+    indio_dev->name = I2C_SLAVE_NAME;
+    indio_dev->channels = max30100_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(max30100_iio_channels);
+    indio_dev->info = &max30100_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->available_scan_masks = max30100_iio_scan_masks;
+
+    ret = devm_iio_kfifo_buffer_setup_ext(&client->dev, indio_dev, INDIO_BUFFER_SOFTWARE,
+                                          &max30100_iio_buffer_ops, max30100_iio_fifo_attrs);
+    if (ret)
+        return ret;
+
+    ret = max30100_iio_chip_init(data);
+    if (ret)
+        return ret;
+
+    ret = devm_add_action_or_reset(&client->dev, max30100_iio_shutdown, data);
+    if (ret)
+        return ret;
+
+    ret = devm_request_threaded_irq(&client->dev, client->irq, max30100_iio_irq_handler,
+                                    max30100_iio_irq_thread, IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
+                                    "max30100_irq", indio_dev);
+    if (ret)
+        return ret;
+
+    return devm_iio_device_register(&client->dev, indio_dev);
+}
+
+// Matching Tables
+static const struct of_device_id max30100_iio_of_match[] = {
+    {.compatible = "MSDhoni,max30100"}, // matching with device tree
+    {}};
+MODULE_DEVICE_TABLE(of, max30100_iio_of_match);
+
+static const struct i2c_device_id max30100_iio_id[] = {
+    {I2C_SLAVE_NAME, 0},
+    {}};
+MODULE_DEVICE_TABLE(i2c, max30100_iio_id);
+
+// I2C Driver Structure
+static struct i2c_driver max30100_iio_driver = {
+    .driver = {
+        .name = "max30100_iio",
+        .of_match_table = of_match_ptr(max30100_iio_of_match),
+    },
+    .probe = max30100_iio_probe,
+    .id_table = max30100_iio_id,
+};
+
+module_i2c_driver(max30100_iio_driver);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Varad Kalekar,Satyam Patil,Sourabh Divate,Srushti Nakate");
+MODULE_DESCRIPTION("IIO buffered driver for MAX30100 pulse oximeter");
@@ -0,0 +1,72 @@
+/*
+ * MAX30100 heart rate / SpO2 monitor
+ *
+ * Reads binary sample records from a MAX30100 character device and prints
+ * the estimates of max30100_spo2 on every heart beat.
+ *
+ *   gcc -O2 -o max30100_monitor max30100_monitor.c max30100_spo2.c -lm
+ *   ./max30100_monitor /dev/max30100-0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "max30100.h"
+#include "max30100_spo2.h"
+
+#define RECORDS_PER_READ 64
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/dev/max30100-0";
+    struct max30100_record recs[RECORDS_PER_READ];
+    struct max30100_config cfg;
+    max30100_spo2 st;
+    max30100_spo2_result res;
+    int format = MAX30100_FMT_BINARY;
+    ssize_t len;
+    int fd, i, n;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+
+    if (ioctl(fd, MAX30100_IOC_SET_FORMAT, &format) < 0 || ioctl(fd, MAX30100_IOC_GET_CONFIG, &cfg) < 0) {
+        perror("ioctl");
+        close(fd);
+        return 1;
+    }
+
+    max30100_spo2_init(&st, cfg.sample_rate_hz);
+    printf("%s: %u Hz, %s mode\n", path, cfg.sample_rate_hz, cfg.mode == MAX30100_MODE_HR ? "hr" : "spo2");
+
+    while ((len = read(fd, recs, sizeof(recs))) > 0) {
+        n = len / sizeof(recs[0]);
+        for (i = 0; i < n; i++) {
+            if (!max30100_spo2_update(&st, recs[i].ir, recs[i].red, &res))
+                continue;
+            if (res.valid & MAX30100_SPO2_HR_VALID)
+                printf("HR %5.1f bpm", res.heart_rate_bpm);
+            else
+                printf("HR   --- bpm");
+            if (res.valid & MAX30100_SPO2_SPO2_VALID)
+                printf("  SpO2 %5.1f %%", res.spo2_percent);
+            else
+                printf("  SpO2  --- %%");
+            if (recs[i].flags & MAX30100_REC_TEMP)
+                printf("  die %5.2f C", recs[i].temp / 16.0);
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    if (len < 0)
+        perror("read");
+    close(fd);
+    return 0;
+}
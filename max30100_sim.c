@@ -0,0 +1,535 @@
+// Software MAX30100 on a virtual I2C adapter, for testing my_project.c
+// without the sensor.
+//
+// Like i2c-stub, the module registers an I2C adapter whose transfers never
+// leave the machine, but instead of plain register memory it models the
+// MAX30100: PWR_RDY after power up, MODE/SPO2/LED configuration, a
+// 16-entry FIFO that fills in real time at the configured sample rate with
+// wrap-around write/read pointers and a saturating overflow counter, and
+// FIFO_DATA returning a synthetic PPG waveform. A "max30100" client is
+// created on every adapter, so the driver binds as it would to a real
+// board (without an INT line, i.e. in polling mode):
+//
+//     insmod my_project.ko
+//     insmod max30100_sim.ko nr_chips=4 bus_khz=400 bpm=72 spo2=97
+//
+// Per chip counters in /sys/kernel/debug/max30100_sim/<adapter>/stats show
+// how many samples the model produced, how many the driver read and how
+// many were lost to FIFO overflow.
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/i2c.h>
+#include <linux/delay.h>
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#define SIM_MAX_CHIPS 8
+#define SIM_ADDR 0x57 // MAX30100 7-bit address
+
+// Register map
+#define REG_INT_STATUS 0x00
+#define REG_INT_ENABLE 0x01
+#define REG_FIFO_WR_PTR 0x02
+#define REG_OVF_COUNTER 0x03
+#define REG_FIFO_RD_PTR 0x04
+#define REG_FIFO_DATA 0x05
+#define REG_MODE_CONFIG 0x06
+#define REG_SPO2_CONFIG 0x07
+#define REG_LED_CONFIG 0x09
+#define REG_TEMP_INTEGER 0x16
+#define REG_TEMP_FRACTION 0x17
+#define REG_REV_ID 0xFE
+#define REG_PART_ID 0xFF
+
+#define INT_A_FULL BIT(7)
+#define INT_TEMP_RDY BIT(6)
+#define INT_HR_RDY BIT(5)
+#define INT_SPO2_RDY BIT(4)
+#define INT_PWR_RDY BIT(0)
+
+#define MODE_SHDN BIT(7)
+#define MODE_RESET BIT(6)
+#define MODE_TEMP_EN BIT(3)
+#define MODE_MASK GENMASK(2, 0)
+#define MODE_HR 0x02
+#define MODE_SPO2 0x03
+
+#define FIFO_DEPTH 16
+#define FIFO_SAMPLE_SIZE 4
+#define FIFO_A_FULL_LEVEL 15
+#define OVF_MAX 0x0F
+
+static unsigned int nr_chips = 1;
+module_param(nr_chips, uint, 0444);
+MODULE_PARM_DESC(nr_chips, "Number of simulated sensors, one adapter each (1-8)");
+
+static unsigned int bus_khz = 400;
+module_param(bus_khz, uint, 0644);
+MODULE_PARM_DESC(bus_khz, "Emulated I2C clock for transfer times, 0 for instant transfers");
+
+static unsigned int bpm = 72;
+module_param(bpm, uint, 0644);
+MODULE_PARM_DESC(bpm, "Heart rate of the synthetic pulse");
+
+static unsigned int spo2 = 97;
+module_param(spo2, uint, 0644);
+MODULE_PARM_DESC(spo2, "SpO2 (%) encoded in the red/IR pulse amplitudes");
+
+static int temp_c = 31;
+module_param(temp_c, int, 0644);
+MODULE_PARM_DESC(temp_c, "Die temperature reported by the temperature sensor");
+
+static bool attach = true;
+module_param(attach, bool, 0444);
+MODULE_PARM_DESC(attach, "Create a max30100 client on each adapter");
+
+// Samples per second for each SPO2_SR value
+static const unsigned int sim_sample_rates[] = {50, 100, 167, 200, 400, 600, 800, 1000};
+
+// One heart beat, 64 steps: systolic peak followed by a dicrotic wave (0-1000)
+static const u16 sim_pulse[64] = {
+    0, 40, 160, 380, 650, 870, 990, 1000, 930, 820, 700, 590, 500, 430, 380, 350,
+    340, 350, 370, 390, 400, 400, 390, 370, 340, 310, 280, 250, 225, 200, 180, 160,
+    145, 130, 118, 106, 96, 87, 79, 72, 65, 59, 53, 48, 43, 39, 35, 31,
+    28, 25, 22, 20, 18, 16, 14, 12, 10, 9, 7, 6, 4, 3, 2, 1};
+
+struct max30100_sim
+{
+    struct i2c_adapter adap;
+    struct i2c_client *client;
+    struct mutex lock;
+    struct dentry *debugfs;
+
+    u8 regs[256];
+    u8 ptr; // register pointer set by the last write
+    u8 fifo[FIFO_DEPTH][FIFO_SAMPLE_SIZE];
+    unsigned int count; // samples in the FIFO
+    unsigned int popped; // bytes of the current sample already read
+
+    // Sampling clock: samples due since t0 at the current rate
+    u64 t0_ns;
+    u64 produced_since_t0;
+    u32 phase; // pulse phase, 2^32 per beat
+    u32 noise;
+
+    // Counters
+    u64 produced;
+    u64 read;
+    u64 lost;
+    u64 xfers;
+    u64 bytes;
+};
+
+static struct max30100_sim *sim_chips[SIM_MAX_CHIPS];
+static struct dentry *sim_debugfs_root;
+
+static bool sim_sampling(struct max30100_sim *sim)
+{
+    u8 mode = sim->regs[REG_MODE_CONFIG];
+
+    if (mode & MODE_SHDN)
+        return false;
+    mode &= MODE_MASK;
+    return mode == MODE_HR || mode == MODE_SPO2;
+}
+
+static unsigned int sim_rate(struct max30100_sim *sim)
+{
+    return sim_sample_rates[(sim->regs[REG_SPO2_CONFIG] >> 2) & 0x7];
+}
+
+// Restarts the sampling clock, e.g. after the rate or mode changed
+static void sim_restart_clock(struct max30100_sim *sim)
+{
+    sim->t0_ns = ktime_get_ns();
+    sim->produced_since_t0 = 0;
+}
+
+// Pulse phase advance per sample, 2^32 per beat
+static u32 sim_phase_step(struct max30100_sim *sim)
+{
+    return div_u64((u64)bpm << 32, 60 * sim_rate(sim));
+}
+
+// Produces one ADC sample pair from the pulse table, scaled like the chip:
+// LED current sets the DC level, pulse width the ADC resolution
+static void sim_make_sample(struct max30100_sim *sim, u8 *out)
+{
+    u8 led = sim->regs[REG_LED_CONFIG];
+    unsigned int bits = 13 + (sim->regs[REG_SPO2_CONFIG] & 0x3);
+    u32 full = (1U << bits) - 1;
+    u32 pulse = sim_pulse[sim->phase >> 26];
+    u32 dc_ir = full / 20 * (led & 0xF);
+    u32 dc_red = full / 20 * (led >> 4);
+    // 1% IR modulation; red modulation from SpO2 = 110 - 25 R
+    u32 ac_ir = dc_ir / 100;
+    u32 ac_red = dc_red * (110 - min(spo2, 110U)) / 2500;
+    u32 ir, red;
+
+    sim->noise = sim->noise * 1664525 + 1013904223;
+
+    // Absorption rises with blood volume, so the pulse shows as a dip
+    ir = dc_ir - ac_ir * pulse / 1000 + (sim->noise >> 29);
+    red = dc_red - ac_red * pulse / 1000 + ((sim->noise >> 26) & 0x7);
+    if ((sim->regs[REG_MODE_CONFIG] & MODE_MASK) != MODE_SPO2)
+        red = 0;
+
+    ir = min(ir, full);
+    red = min(red, full);
+    out[0] = ir >> 8;
+    out[1] = ir;
+    out[2] = red >> 8;
+    out[3] = red;
+
+    sim->phase += sim_phase_step(sim);
+}
+
+// Brings the FIFO up to date with the time elapsed since the last access
+static void sim_update(struct max30100_sim *sim)
+{
+    u64 due;
+
+    if (!sim_sampling(sim))
+        return;
+
+    due = div_u64((ktime_get_ns() - sim->t0_ns) * sim_rate(sim), NSEC_PER_SEC);
+    // A long idle period only matters up to one FIFO's worth plus the overflow count
+    if (due - sim->produced_since_t0 > FIFO_DEPTH + OVF_MAX + 1)
+    {
+        u64 skip = due - sim->produced_since_t0 - (FIFO_DEPTH + OVF_MAX + 1);
+
+        sim->produced_since_t0 += skip;
+        sim->produced += skip;
+        sim->lost += skip;
+        sim->phase += (u32)skip * sim_phase_step(sim);
+    }
+
+    while (sim->produced_since_t0 < due)
+    {
+        sim->produced_since_t0++;
+        sim->produced++;
+
+        if (sim->count == FIFO_DEPTH)
+        {
+            // Full: the new sample is lost and counted
+            sim->lost++;
+            if (sim->regs[REG_OVF_COUNTER] < OVF_MAX)
+                sim->regs[REG_OVF_COUNTER]++;
+            continue;
+        }
+
+        sim_make_sample(sim, sim->fifo[sim->regs[REG_FIFO_WR_PTR]]);
+        sim->regs[REG_FIFO_WR_PTR] = (sim->regs[REG_FIFO_WR_PTR] + 1) & (FIFO_DEPTH - 1);
+        sim->count++;
+
+        sim->regs[REG_INT_STATUS] |= (sim->regs[REG_MODE_CONFIG] & MODE_MASK) == MODE_SPO2 ? INT_SPO2_RDY
+                                                                                           : INT_HR_RDY;
+        if (sim->count == FIFO_A_FULL_LEVEL)
+            sim->regs[REG_INT_STATUS] |= INT_A_FULL;
+    }
+}
+
+static void sim_reset(struct max30100_sim *sim)
+{
+    memset(sim->regs, 0, sizeof(sim->regs));
+    sim->regs[REG_INT_STATUS] = INT_PWR_RDY;
+    sim->regs[REG_REV_ID] = 0x03;
+    sim->regs[REG_PART_ID] = 0x11;
+    sim->count = 0;
+    sim->popped = 0;
+    sim_restart_clock(sim);
+}
+
+static u8 sim_read_byte(struct max30100_sim *sim)
+{
+    u8 reg = sim->ptr;
+    u8 val;
+
+    switch (reg)
+    {
+    case REG_INT_STATUS:
+        val = sim->regs[reg];
+        sim->regs[reg] = 0; // cleared on read
+        break;
+    case REG_FIFO_DATA:
+        // Pops 4 bytes per sample; an empty FIFO returns the last slot again
+        val = sim->fifo[sim->regs[REG_FIFO_RD_PTR]][sim->popped];
+        if (++sim->popped == FIFO_SAMPLE_SIZE)
+        {
+            sim->popped = 0;
+            if (sim->count)
+            {
+                sim->count--;
+                sim->read++;
+                sim->regs[REG_FIFO_RD_PTR] = (sim->regs[REG_FIFO_RD_PTR] + 1) & (FIFO_DEPTH - 1);
+                sim->regs[REG_OVF_COUNTER] = 0;
+            }
+        }
+        return val; // FIFO_DATA does not advance the register pointer
+    default:
+        val = sim->regs[reg];
+        break;
+    }
+    sim->ptr++;
+    return val;
+}
+
+static void sim_write_byte(struct max30100_sim *sim, u8 val)
+{
+    u8 reg = sim->ptr;
+
+    switch (reg)
+    {
+    case REG_INT_STATUS:
+    case REG_REV_ID:
+    case REG_PART_ID:
+    case REG_TEMP_INTEGER:
+    case REG_TEMP_FRACTION:
+        break; // read only
+    case REG_FIFO_WR_PTR:
+    case REG_FIFO_RD_PTR:
+        sim->regs[reg] = val & (FIFO_DEPTH - 1);
+        sim->count = (sim->regs[REG_FIFO_WR_PTR] - sim->regs[REG_FIFO_RD_PTR]) & (FIFO_DEPTH - 1);
+        sim->popped = 0;
+        break;
+    case REG_OVF_COUNTER:
+        sim->regs[reg] = val & OVF_MAX;
+        break;
+    case REG_MODE_CONFIG:
+        if (val & MODE_RESET)
+        {
+            sim_reset(sim);
+            break;
+        }
+        if (val & MODE_TEMP_EN)
+        {
+            // Conversion takes 29 ms on the chip; the model finishes at once
+            sim->regs[REG_TEMP_INTEGER] = (s8)temp_c;
+            sim->regs[REG_TEMP_FRACTION] = 0x4; // 0.25 degC
+            sim->regs[REG_INT_STATUS] |= INT_TEMP_RDY;
+            val &= ~MODE_TEMP_EN;
+        }
+        if ((val ^ sim->regs[reg]) & (MODE_SHDN | MODE_MASK))
+            sim_restart_clock(sim);
+        sim->regs[reg] = val;
+        break;
+    case REG_SPO2_CONFIG:
+        if ((val ^ sim->regs[reg]) & GENMASK(4, 2))
+            sim_restart_clock(sim);
+        sim->regs[reg] = val;
+        break;
+    default:
+        sim->regs[reg] = val;
+        break;
+    }
+    sim->ptr++;
+}
+
+// Time the transfer would take on a real bus: 9 clocks per byte plus the address byte
+static void sim_bus_delay(unsigned int bytes)
+{
+    unsigned int khz = READ_ONCE(bus_khz);
+    unsigned long us;
+
+    if (!khz)
+        return;
+    us = DIV_ROUND_UP(bytes * 9 * 1000, khz);
+    if (us < 10)
+        udelay(us);
+    else
+        usleep_range(us, us + us / 8);
+}
+
+static int sim_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+    struct max30100_sim *sim = i2c_get_adapdata(adap);
+    unsigned int bytes = 0;
+    int i, j;
+
+    mutex_lock(&sim->lock);
+    sim_update(sim);
+    for (i = 0; i < num; i++)
+    {
+        struct i2c_msg *msg = &msgs[i];
+
+        if (msg->addr != SIM_ADDR)
+        {
+            mutex_unlock(&sim->lock);
+            return -ENXIO;
+        }
+        bytes += msg->len + 1;
+
+        if (msg->flags & I2C_M_RD)
+        {
+            for (j = 0; j < msg->len; j++)
+                msg->buf[j] = sim_read_byte(sim);
+        }
+        else if (msg->len)
+        {
+            sim->ptr = msg->buf[0];
+            for (j = 1; j < msg->len; j++)
+                sim_write_byte(sim, msg->buf[j]);
+        }
+    }
+    sim->xfers++;
+    sim->bytes += bytes;
+    mutex_unlock(&sim->lock);
+
+    sim_bus_delay(bytes);
+    return num;
+}
+
+static u32 sim_func(struct i2c_adapter *adap)
+{
+    return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm sim_algorithm = {
+    .master_xfer = sim_xfer,
+    .functionality = sim_func,
+};
+
+static int sim_stats_show(struct seq_file *s, void *unused)
+{
+    struct max30100_sim *sim = s->private;
+
+    mutex_lock(&sim->lock);
+    sim_update(sim);
+    seq_printf(s, "sample_rate_hz: %u\n", sim_sampling(sim) ? sim_rate(sim) : 0);
+    seq_printf(s, "fifo_count: %u\n", sim->count);
+    seq_printf(s, "produced: %llu\n", sim->produced);
+    seq_printf(s, "read: %llu\n", sim->read);
+    seq_printf(s, "lost: %llu\n", sim->lost);
+    seq_printf(s, "transfers: %llu\n", sim->xfers);
+    seq_printf(s, "bus_bytes: %llu\n", sim->bytes);
+    mutex_unlock(&sim->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sim_stats);
+
+// Writing anything zeroes the counters, e.g. between benchmark runs
+static ssize_t sim_reset_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+    struct max30100_sim *sim = file->private_data;
+
+    mutex_lock(&sim->lock);
+    sim_update(sim);
+    sim->produced = 0;
+    sim->read = 0;
+    sim->lost = 0;
+    sim->xfers = 0;
+    sim->bytes = 0;
+    mutex_unlock(&sim->lock);
+    return count;
+}
+
+static const struct file_operations sim_reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = sim_reset_write,
+    .llseek = noop_llseek,
+};
+
+static struct max30100_sim *sim_create(unsigned int index)
+{
+    struct i2c_board_info info = {
+        I2C_BOARD_INFO("max30100", SIM_ADDR),
+    };
+    struct max30100_sim *sim;
+    int ret;
+
+    sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+    if (!sim)
+        return ERR_PTR(-ENOMEM);
+
+    mutex_init(&sim->lock);
+    sim->noise = index + 1;
+    sim_reset(sim);
+
+    sim->adap.owner = THIS_MODULE;
+    sim->adap.class = I2C_CLASS_HWMON;
+    sim->adap.algo = &sim_algorithm;
+    snprintf(sim->adap.name, sizeof(sim->adap.name), "MAX30100 simulator %u", index);
+    i2c_set_adapdata(&sim->adap, sim);
+
+    ret = i2c_add_adapter(&sim->adap);
+    if (ret)
+    {
+        kfree(sim);
+        return ERR_PTR(ret);
+    }
+
+    sim->debugfs = debugfs_create_dir(dev_name(&sim->adap.dev), sim_debugfs_root);
+    debugfs_create_file("stats", 0444, sim->debugfs, sim, &sim_stats_fops);
+    debugfs_create_file("reset_stats", 0200, sim->debugfs, sim, &sim_reset_fops);
+
+    if (attach)
+    {
+        sim->client = i2c_new_client_device(&sim->adap, &info);
+        if (IS_ERR(sim->client))
+        {
+            pr_err("MAX30100 sim: cannot create client on %s\n", sim->adap.name);
+            sim->client = NULL;
+        }
+    }
+
+    pr_info("MAX30100 sim: %s at 0x%02x\n", dev_name(&sim->adap.dev), SIM_ADDR);
+    return sim;
+}
+
+static void sim_destroy(struct max30100_sim *sim)
+{
+    if (sim->client)
+        i2c_unregister_device(sim->client);
+    debugfs_remove_recursive(sim->debugfs);
+    i2c_del_adapter(&sim->adap);
+    kfree(sim);
+}
+
+static int __init max30100_sim_init(void)
+{
+    unsigned int i;
+
+    if (nr_chips < 1 || nr_chips > SIM_MAX_CHIPS)
+        return -EINVAL;
+
+    sim_debugfs_root = debugfs_create_dir("max30100_sim", NULL);
+    for (i = 0; i < nr_chips; i++)
+    {
+        sim_chips[i] = sim_create(i);
+        if (IS_ERR(sim_chips[i]))
+        {
+            int ret = PTR_ERR(sim_chips[i]);
+
+            sim_chips[i] = NULL;
+            while (i--)
+                sim_destroy(sim_chips[i]);
+            debugfs_remove_recursive(sim_debugfs_root);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void __exit max30100_sim_exit(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr_chips; i++)
+        if (sim_chips[i])
+            sim_destroy(sim_chips[i]);
+    debugfs_remove_recursive(sim_debugfs_root);
+}
+
+module_init(max30100_sim_init);
+module_exit(max30100_sim_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Varad Kalekar,Satyam Patil,Sourabh Divate,Srushti Nakate");
+MODULE_DESCRIPTION("Simulated MAX30100 on a virtual I2C adapter");
@@ -0,0 +1,192 @@
+/*
+ * Streaming heart rate and SpO2 estimation for MAX30100 IR/Red samples
+ *
+ * Per sample: DC tracking, 0.5 - 5 Hz band-pass, AC power tracking and a
+ * peak detector on the IR pulse. Per detected beat: heart rate from the
+ * averaged beat interval and SpO2 from the ratio of ratios
+ * R = (AC_red / DC_red) / (AC_ir / DC_ir).
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "max30100_spo2.h"
+
+/* Band of plausible pulse frequencies */
+#define BAND_LOW_HZ 0.5f
+#define BAND_HIGH_HZ 5.0f
+
+/* Time constants of the DC and AC trackers and of the peak threshold decay */
+#define DC_TAU_S 1.0f
+#define AC_TAU_S 2.0f
+#define PEAK_TAU_S 3.0f
+
+/* Accepted beat intervals: 200 bpm down to 30 bpm */
+#define MIN_BEAT_S 0.3f
+#define MAX_BEAT_S 2.0f
+
+/* Below this IR DC level no finger is on the sensor */
+#define MIN_FINGER_DC 5000.0f
+
+/*
+ * Linear SpO2 = A - B * R fit used by the MAX30100 reference designs.
+ * Calibrate against a reference oximeter for a given enclosure.
+ */
+#define SPO2_A 110.0f
+#define SPO2_B 25.0f
+
+/* Smoothing factor of a first order tracker with time constant tau_s */
+static float ema_alpha(float tau_s, float sample_rate_hz)
+{
+    return 1.0f - expf(-1.0f / (tau_s * sample_rate_hz));
+}
+
+/* Butterworth high or low pass section with cleared state */
+static void biquad_design(max30100_biquad *bq, float cutoff_hz, float sample_rate_hz, int high_pass)
+{
+    ppg_biquad_design(&bq->k, cutoff_hz, sample_rate_hz, high_pass);
+    bq->z1 = 0.0f;
+    bq->z2 = 0.0f;
+}
+
+static inline float biquad_run(max30100_biquad *bq, float x)
+{
+    float y = bq->k.b0 * x + bq->z1;
+
+    bq->z1 = bq->k.b1 * x - bq->k.a1 * y + bq->z2;
+    bq->z2 = bq->k.b2 * x - bq->k.a2 * y;
+    return y;
+}
+
+/* Forget the pulse history, e.g. after the finger was lifted */
+static void reset_beats(max30100_spo2 *st)
+{
+    st->interval_sum = 0;
+    st->interval_count = 0;
+    st->interval_pos = 0;
+    st->peak_level = 0.0f;
+    st->heart_rate_bpm = 0.0f;
+    st->spo2_percent = 0.0f;
+}
+
+/**
+ * @brief Initialise a channel for the given sample rate
+ */
+void max30100_spo2_init(max30100_spo2 *st, float sample_rate_hz)
+{
+    memset(st, 0, sizeof(*st));
+    st->sample_rate_hz = sample_rate_hz;
+
+    st->dc_alpha = ema_alpha(DC_TAU_S, sample_rate_hz);
+    st->ms_alpha = ema_alpha(AC_TAU_S, sample_rate_hz);
+    st->peak_decay = 1.0f - ema_alpha(PEAK_TAU_S, sample_rate_hz);
+
+    biquad_design(&st->hp_ir, BAND_LOW_HZ, sample_rate_hz, 1);
+    biquad_design(&st->lp_ir, BAND_HIGH_HZ, sample_rate_hz, 0);
+    st->hp_red = st->hp_ir;
+    st->lp_red = st->lp_ir;
+
+    st->min_interval = (uint32_t)(MIN_BEAT_S * sample_rate_hz);
+    st->max_interval = (uint32_t)(MAX_BEAT_S * sample_rate_hz);
+}
+
+/* Called on every detected beat: updates heart rate and SpO2 */
+static void on_beat(max30100_spo2 *st, uint32_t interval)
+{
+    float ac_ir, ac_red, ratio;
+
+    if (interval >= st->min_interval && interval <= st->max_interval) {
+        if (st->interval_count == MAX30100_SPO2_BEATS)
+            st->interval_sum -= st->intervals[st->interval_pos];
+        else
+            st->interval_count++;
+        st->intervals[st->interval_pos] = interval;
+        st->interval_sum += interval;
+        st->interval_pos = (st->interval_pos + 1) % MAX30100_SPO2_BEATS;
+
+        st->heart_rate_bpm = 60.0f * st->sample_rate_hz * st->interval_count / st->interval_sum;
+    }
+
+    // Ratio of ratios from the RMS pulse amplitude of both colours
+    if (st->dc_red <= 0.0f || st->ms_ir <= 0.0f) {
+        st->spo2_percent = 0.0f;
+        return;
+    }
+    ac_ir = sqrtf(st->ms_ir);
+    ac_red = sqrtf(st->ms_red);
+    ratio = (ac_red / st->dc_red) / (ac_ir / st->dc_ir);
+    st->spo2_percent = SPO2_A - SPO2_B * ratio;
+    if (st->spo2_percent > 100.0f)
+        st->spo2_percent = 100.0f;
+    if (st->spo2_percent < 0.0f)
+        st->spo2_percent = 0.0f;
+}
+
+/**
+ * @brief Feed one IR/Red sample
+ */
+int max30100_spo2_update(max30100_spo2 *st, uint16_t ir, uint16_t red, max30100_spo2_result *res)
+{
+    float x_ir = ir;
+    float x_red = red;
+    float bp_ir, bp_red, v;
+    int beat = 0;
+
+    // Start the DC trackers at the first sample so the filters see no step
+    if (!st->primed) {
+        st->dc_ir = x_ir;
+        st->dc_red = x_red;
+        st->primed = 1;
+    }
+    st->dc_ir += (x_ir - st->dc_ir) * st->dc_alpha;
+    st->dc_red += (x_red - st->dc_red) * st->dc_alpha;
+
+    bp_ir = biquad_run(&st->lp_ir, biquad_run(&st->hp_ir, x_ir - st->dc_ir));
+    bp_red = biquad_run(&st->lp_red, biquad_run(&st->hp_red, x_red - st->dc_red));
+
+    st->ms_ir += (bp_ir * bp_ir - st->ms_ir) * st->ms_alpha;
+    st->ms_red += (bp_red * bp_red - st->ms_red) * st->ms_alpha;
+
+    if (st->dc_ir < MIN_FINGER_DC) {
+        reset_beats(st);
+        st->since_peak = 0;
+        goto out;
+    }
+
+    // Blood volume peaks absorb the most light, so beats are minima of the IR signal
+    v = -bp_ir;
+    st->since_peak++;
+    st->peak_level *= st->peak_decay;
+    if (st->prev1 > st->prev2 && st->prev1 >= v && st->prev1 > 0.5f * st->peak_level &&
+        st->since_peak > st->min_interval) {
+        if (st->prev1 > st->peak_level)
+            st->peak_level = st->prev1;
+        else
+            st->peak_level += (st->prev1 - st->peak_level) * 0.25f;
+
+        on_beat(st, st->since_peak);
+        st->since_peak = 0;
+        beat = 1;
+    }
+    st->prev2 = st->prev1;
+    st->prev1 = v;
+
+    // Pulse lost for too long: the averaged intervals no longer apply
+    if (st->since_peak > st->max_interval + st->max_interval / 4) {
+        reset_beats(st);
+        st->since_peak = 0;
+    }
+
+out:
+    if (res) {
+        res->heart_rate_bpm = st->heart_rate_bpm;
+        res->spo2_percent = st->spo2_percent;
+        res->valid = 0;
+        if (st->interval_count >= 2)
+            res->valid |= MAX30100_SPO2_HR_VALID;
+        if (st->interval_count >= 2 && st->spo2_percent > 0.0f)
+            res->valid |= MAX30100_SPO2_SPO2_VALID;
+        res->beat = beat;
+    }
+    return beat;
+}
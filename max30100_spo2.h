@@ -0,0 +1,94 @@
+/*
+ * Streaming heart rate and SpO2 estimation for MAX30100 IR/Red samples
+ *
+ * One max30100_spo2 state per sensor channel. The state is a fixed size
+ * structure and max30100_spo2_update() does a constant amount of work per
+ * sample without allocating, so a single core can run many channels by
+ * keeping an array of states and feeding each one its samples.
+ */
+
+#ifndef MAX30100_SPO2_H
+#define MAX30100_SPO2_H
+
+#include <stdint.h>
+
+#include "ppg_biquad.h"
+
+/* Heart beat intervals averaged for the heart rate */
+#define MAX30100_SPO2_BEATS 8
+
+/* Validity bits of max30100_spo2_result.valid */
+#define MAX30100_SPO2_HR_VALID 0x01
+#define MAX30100_SPO2_SPO2_VALID 0x02
+
+/* Second order IIR section, transposed direct form II */
+typedef struct {
+    ppg_biquad_coeffs k;
+    float z1, z2;
+} max30100_biquad;
+
+/* Per channel estimator state */
+typedef struct {
+    float sample_rate_hz;
+
+    /* DC tracking (also the denominator of the ratio of ratios) */
+    float dc_alpha;
+    float dc_ir;
+    float dc_red;
+    int primed;
+
+    /* 0.5 - 5 Hz band-pass, high-pass then low-pass section per colour */
+    max30100_biquad hp_ir, lp_ir;
+    max30100_biquad hp_red, lp_red;
+
+    /* Mean square of the pulsatile (AC) part */
+    float ms_alpha;
+    float ms_ir;
+    float ms_red;
+
+    /* Peak detector on the inverted IR pulse */
+    float prev1, prev2;
+    float peak_level;
+    float peak_decay;
+    uint32_t since_peak;
+    uint32_t min_interval;
+    uint32_t max_interval;
+
+    /* Last beat intervals in samples */
+    uint32_t intervals[MAX30100_SPO2_BEATS];
+    uint32_t interval_sum;
+    unsigned int interval_count;
+    unsigned int interval_pos;
+
+    float heart_rate_bpm;
+    float spo2_percent;
+} max30100_spo2;
+
+/* Estimates after a sample */
+typedef struct {
+    float heart_rate_bpm; // valid when (valid & MAX30100_SPO2_HR_VALID)
+    float spo2_percent;   // valid when (valid & MAX30100_SPO2_SPO2_VALID)
+    int valid;
+    int beat; // 1 if this sample completed a heart beat
+} max30100_spo2_result;
+
+/**
+ * @brief Initialise a channel for the given sample rate
+ *
+ * @param st Channel state
+ * @param sample_rate_hz Sensor sample rate (50 - 1000 Hz)
+ */
+void max30100_spo2_init(max30100_spo2 *st, float sample_rate_hz);
+
+/**
+ * @brief Feed one IR/Red sample
+ *
+ * @param st Channel state
+ * @param ir Raw IR count
+ * @param red Raw Red count (0 in heart rate only mode, SpO2 stays invalid)
+ * @param res Estimates after this sample, may be NULL
+ * @return 1 if the sample completed a heart beat, 0 otherwise
+ */
+int max30100_spo2_update(max30100_spo2 *st, uint16_t ir, uint16_t red, max30100_spo2_result *res);
+
+#endif // MAX30100_SPO2_H
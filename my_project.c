@@ -8,23 +8,179 @@
 #include <linux/cdev.h>
 #include <linux/of.h>
 #include <linux/uaccess.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/regmap.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+
+#include "max30100.h"
+#include "i2c_batch.h"
 
 #define I2C_SLAVE_NAME "max30100"
 
 // Register definitions
 #define REG_INT_STATUS 0x00
+#define REG_INT_ENABLE 0x01
+#define REG_FIFO_WR_PTR 0x02
+#define REG_OVF_COUNTER 0x03
+#define REG_FIFO_RD_PTR 0x04
 #define REG_MODE_CONFIG 0x06
 #define REG_SPO2_CONFIG 0x07
 #define REG_LED_CONFIG 0x09
 #define REG_FIFO_DATA 0x05
+#define REG_TEMP_INTEGER 0x16
+#define REG_TEMP_FRACTION 0x17
+#define REG_PART_ID 0xFF
+
+#define MODE_MASK GENMASK(2, 0)
+#define SPO2_CONFIG_MASK GENMASK(6, 0)
+#define SPO2_HI_RES_EN BIT(6)
+#define MODE_TEMP_EN BIT(3) // starts one temperature conversion, self-clearing
+
+// Interrupt status/enable bits
+#define INT_A_FULL BIT(7)
+#define INT_SPO2_RDY BIT(4)
+#define INT_PWR_RDY BIT(0)
+
+// Chip FIFO holds 16 samples of 4 bytes (IR msb/lsb, Red msb/lsb)
+#define FIFO_DEPTH 16
+#define FIFO_SAMPLE_SIZE 4
+
+// Samples buffered in the driver between the chip FIFO and readers (power of 2)
+#define SAMPLE_BUF_SIZE 256
+
+// Without an INT line the FIFO is drained by a timer once this many samples
+// have accumulated, leaving the other half of the FIFO as slack for timer and
+// workqueue latency (8 ms at 1 kHz)
+#define POLL_WATERMARK (FIFO_DEPTH / 2)
+
+// A temperature conversion takes 29 ms, its result is picked up by the first drain after that
+#define TEMP_CONV_NS (30 * NSEC_PER_MSEC)
+#define TEMP_PERIOD_MIN_MS 100
+#define TEMP_PERIOD_MAX_MS 60000
+
+// Sensors handled at once, one minor number each
+#define MAX30100_MAX_DEVICES 16
+
+// Bring-up progress of a sensor, see max30100_init_work()
+enum max30100_state
+{
+    MAX30100_STARTING,
+    MAX30100_READY,
+    MAX30100_FAILED,
+};
+
+// Per sensor state, allocated at probe. Open files hold a reference so the
+// state outlives a removal until the last user is gone.
+struct max30100_data
+{
+    struct kref kref;
+    struct i2c_client *client;
+    struct regmap *regmap;
+    struct cdev *cdev;
+    int minor;
+    bool removed; // set with bus_lock, cfg_lock and ring_lock held; no chip access afterwards
+
+    // Chip bring-up runs in init_work so probe does not wait for PWR_RDY
+    struct work_struct init_work;
+    enum max30100_state state;
+    bool chip_up;       // PWR_RDY seen, set with cfg_lock held; config changes go to the chip
+    bool irq_requested;
+
+    // Sample buffering: filled by the IRQ thread, drained by read()
+    DECLARE_KFIFO(samples, struct max30100_record, SAMPLE_BUF_SIZE);
+    wait_queue_head_t wq;
+    struct mutex bus_lock;  // serialises FIFO drains
+    struct mutex read_lock; // serialises readers (kfifo consumer side)
+    u8 fifo_buf[FIFO_DEPTH * FIFO_SAMPLE_SIZE];
+    unsigned long dropped;
+
+    // Sample timing: reconstructed timestamps and the statistics behind them
+    u64 sample_period_ns;
+    u64 irq_ns;  // time the chip last raised INT, 0 once used
+    u64 ts_next; // expected time of the next sample, 0 when unknown
+    bool gap;    // samples were lost since the last stored record
+    u64 overflows;
+    u64 jitter_max_ns;
+    u64 jitter_sum_ns;
+    u64 jitter_count;
+    u64 latency_max_ns;
+    u64 latency_sum_ns;
+    u64 latency_count;
+
+    // Die temperature, converted and read back during FIFO drains (bus_lock)
+    u64 temp_period_ns; // 0: no temperature sampling
+    u64 temp_start_ns;  // conversion in flight since, 0 if none
+    u64 temp_last_ns;   // last conversion started
+    s16 temp;           // 1/16 degC
+    bool temp_valid;
+
+    // Polling mode (no IRQ): poll_timer fires every poll_period_ns and queues poll_work
+    bool polled;
+    struct hrtimer poll_timer;
+    struct work_struct poll_work;
+    u64 poll_period_ns;
 
-// Global pointer for the I2C client.
-static struct i2c_client *max30100_client = NULL;
+    // Shared sample ring for mmap() consumers: control page followed by the records
+    struct max30100_ring_ctrl *ring;
+    struct max30100_record *ring_slots;
+    atomic_t ring_maps;
+    struct mutex ring_lock;
+
+    // Current measurement settings
+    struct max30100_config cfg;
+    struct mutex cfg_lock;
+
+    // Register accesses the driver asked for versus I2C transactions issued;
+    // a bulk or FIFO burst read counts as one access, like it is one transaction
+    atomic_long_t reg_reads;
+    atomic_long_t reg_writes;
+    atomic_long_t bus_reads;
+    atomic_long_t bus_writes;
+    struct dentry *debugfs;
+};
+
+// Per open file state
+struct max30100_file
+{
+    struct max30100_data *data;
+    int format; // MAX30100_FMT_TEXT or MAX30100_FMT_BINARY
+};
 
-// Character device globals
-static dev_t devno;
+// Character device globals, shared by all sensors
+static dev_t devno; // first number of the MAX30100_MAX_DEVICES region
 static struct class *max30100_class;
-static struct cdev max30100_cdev;
+static DEFINE_IDR(max30100_idr); // minor -> struct max30100_data
+static DEFINE_MUTEX(max30100_idr_lock);
+static struct dentry *max30100_debugfs_root;
+
+// Datasheet tables, indexed by register field value
+static const unsigned int max30100_sample_rates[] = {50, 100, 167, 200, 400, 600, 800, 1000};
+static const unsigned int max30100_pulse_widths[] = {200, 400, 800, 1600};
+static const unsigned int max30100_led_currents[] = {0, 4400, 7600, 11000, 14200, 17400, 20800, 24000,
+                                                     27100, 30600, 33800, 37000, 40200, 43600, 46800, 50000};
+// Longest pulse width index allowed at each sample rate index
+static const u8 max30100_spo2_max_pw[] = {3, 3, 2, 2, 1, 0, 0, 0};
+static const u8 max30100_hr_max_pw[] = {3, 3, 2, 2, 1, 1, 1, 1};
+
+static const struct max30100_config max30100_default_cfg = {
+    .mode = MAX30100_MODE_SPO2,
+    .sample_rate_hz = 100,
+    .pulse_width_us = 1600,
+    .ir_current_ua = 24000,
+    .red_current_ua = 24000,
+};
 
 // Forward declarations
 static int max30100_probe(struct i2c_client *client, const struct i2c_device_id *id);
@@ -32,196 +188,1135 @@ static int max30100_remove(struct i2c_client *client);
 static int max30100_open(struct inode *inode, struct file *pfile);
 static int max30100_close(struct inode *inode, struct file *pfile);
 static ssize_t max30100_read(struct file *file, char __user *buf, size_t count, loff_t *offset);
-static int max30100_init_chip(void);
+static __poll_t max30100_poll(struct file *file, poll_table *wait);
+static long max30100_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int max30100_mmap(struct file *file, struct vm_area_struct *vma);
+static int max30100_init_chip(struct max30100_data *data);
+
+// regmap bus callbacks: each call is exactly one I2C transaction
+static int max30100_bus_write(void *context, const void *buf, size_t count)
+{
+    struct max30100_data *data = context;
+    int ret;
+
+    atomic_long_inc(&data->bus_writes);
+    ret = i2c_master_send(data->client, buf, count);
+    if (ret == count)
+        return 0;
+    return ret < 0 ? ret : -EIO;
+}
+
+static int max30100_bus_read(void *context, const void *reg_buf, size_t reg_size, void *val_buf,
+                             size_t val_size)
+{
+    struct max30100_data *data = context;
+
+    // Register address and data in one combined transfer
+    atomic_long_inc(&data->bus_reads);
+    return i2c_burst_read(data->client, reg_buf, reg_size, val_buf, val_size);
+}
+
+static const struct regmap_bus max30100_regmap_bus = {
+    .write = max30100_bus_write,
+    .read = max30100_bus_read,
+};
+
+// Status, FIFO and temperature registers change under the driver's feet
+static bool max30100_volatile_reg(struct device *dev, unsigned int reg)
+{
+    switch (reg)
+    {
+    case REG_INT_STATUS:
+    case REG_FIFO_WR_PTR:
+    case REG_OVF_COUNTER:
+    case REG_FIFO_RD_PTR:
+    case REG_FIFO_DATA:
+    case REG_TEMP_INTEGER:
+    case REG_TEMP_FRACTION:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Reads with side effects: INT_STATUS clears on read, FIFO_DATA pops a sample
+static bool max30100_precious_reg(struct device *dev, unsigned int reg)
+{
+    return reg == REG_INT_STATUS || reg == REG_FIFO_DATA;
+}
+
+static bool max30100_noinc_reg(struct device *dev, unsigned int reg)
+{
+    return reg == REG_FIFO_DATA;
+}
+
+static const struct regmap_config max30100_regmap_config = {
+    .reg_bits = 8,
+    .val_bits = 8,
+    .max_register = REG_PART_ID,
+    .volatile_reg = max30100_volatile_reg,
+    .precious_reg = max30100_precious_reg,
+    .readable_noinc_reg = max30100_noinc_reg,
+    .cache_type = REGCACHE_RBTREE,
+};
 
 // Helper function to write a byte to a register
-static int max30100_write_reg(u8 reg, u8 val)
+static int max30100_write_reg(struct max30100_data *data, u8 reg, u8 val)
+{
+    if (data->removed)
+        return -ENODEV;
+    atomic_long_inc(&data->reg_writes);
+    return regmap_write(data->regmap, reg, val);
+}
+
+// Read-modify-write of a register; free of bus traffic when cached and unchanged
+static int max30100_update_reg(struct max30100_data *data, u8 reg, u8 mask, u8 val)
 {
-    if (!max30100_client)
+    if (data->removed)
         return -ENODEV;
-    return i2c_smbus_write_byte_data(max30100_client, reg, val);
+    atomic_long_inc(&data->reg_reads);
+    atomic_long_inc(&data->reg_writes);
+    return regmap_update_bits(data->regmap, reg, mask, val);
 }
 
 // Helper function to read a byte to a register
-static int max30100_read_reg(u8 reg)
+static int max30100_read_reg(struct max30100_data *data, u8 reg)
 {
-    if (!max30100_client)
+    unsigned int val;
+    int ret;
+
+    if (data->removed)
         return -ENODEV;
-    return i2c_smbus_read_byte_data(max30100_client, reg);
+    atomic_long_inc(&data->reg_reads);
+    ret = regmap_read(data->regmap, reg, &val);
+    return ret ? ret : val;
+}
+
+static int max30100_lookup(const unsigned int *table, int size, unsigned int val)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        if (table[i] == val)
+            return i;
+    return -EINVAL;
+}
+
+// Encodes cfg into MODE/SPO2/LED register values, rejecting combinations the datasheet does not allow
+static int max30100_encode_config(const struct max30100_config *cfg, u8 *mode, u8 *spo2, u8 *led)
+{
+    const u8 *max_pw;
+    int sr, pw, ir, red;
+
+    if (cfg->mode == MAX30100_MODE_SPO2)
+        max_pw = max30100_spo2_max_pw;
+    else if (cfg->mode == MAX30100_MODE_HR)
+        max_pw = max30100_hr_max_pw;
+    else
+        return -EINVAL;
+
+    sr = max30100_lookup(max30100_sample_rates, ARRAY_SIZE(max30100_sample_rates), cfg->sample_rate_hz);
+    pw = max30100_lookup(max30100_pulse_widths, ARRAY_SIZE(max30100_pulse_widths), cfg->pulse_width_us);
+    ir = max30100_lookup(max30100_led_currents, ARRAY_SIZE(max30100_led_currents), cfg->ir_current_ua);
+    red = max30100_lookup(max30100_led_currents, ARRAY_SIZE(max30100_led_currents), cfg->red_current_ua);
+    if (sr < 0 || pw < 0 || ir < 0 || red < 0)
+        return -EINVAL;
+    if (pw > max_pw[sr])
+        return -EINVAL;
+    if (cfg->temp_period_ms && (cfg->temp_period_ms < TEMP_PERIOD_MIN_MS || cfg->temp_period_ms > TEMP_PERIOD_MAX_MS))
+        return -EINVAL;
+
+    *mode = cfg->mode;
+    *spo2 = SPO2_HI_RES_EN | (sr << 2) | pw;
+    *led = (red << 4) | ir;
+    return 0;
+}
+
+// Programs cfg; the register cache turns unchanged registers into no-ops and
+// changed ones into a single write. Called with cfg_lock held.
+static int max30100_apply_config(struct max30100_data *data, const struct max30100_config *cfg)
+{
+    u8 mode, spo2, led;
+    int ret;
+
+    ret = max30100_encode_config(cfg, &mode, &spo2, &led);
+    if (ret)
+        return ret;
+
+    // Before the chip is up the settings are only recorded; bring-up programs them
+    if (data->chip_up)
+    {
+        // TEMP_EN is in the mask so a set bit left in the cache by a conversion does not start another
+        ret = max30100_update_reg(data, REG_MODE_CONFIG, MODE_MASK | MODE_TEMP_EN, mode);
+        if (ret == 0)
+            ret = max30100_update_reg(data, REG_SPO2_CONFIG, SPO2_CONFIG_MASK, spo2);
+        if (ret == 0)
+            ret = max30100_update_reg(data, REG_LED_CONFIG, 0xFF, led);
+        if (ret)
+            return ret;
+    }
+
+    // A new rate starts a new sample grid
+    if (cfg->sample_rate_hz != data->cfg.sample_rate_hz)
+        WRITE_ONCE(data->ts_next, 0);
+    data->cfg = *cfg;
+    WRITE_ONCE(data->sample_period_ns, div_u64(NSEC_PER_SEC, cfg->sample_rate_hz));
+    WRITE_ONCE(data->poll_period_ns, data->sample_period_ns * POLL_WATERMARK);
+    WRITE_ONCE(data->temp_period_ns, (u64)cfg->temp_period_ms * NSEC_PER_MSEC);
+    return 0;
 }
 
-// Initializes the MAX30100 chip with the required settings
-static int max30100_init_chip(void)
+static int max30100_set_config(struct max30100_data *data, const struct max30100_config *cfg)
 {
+    int ret;
+
+    mutex_lock(&data->cfg_lock);
+    ret = max30100_apply_config(data, cfg);
+    mutex_unlock(&data->cfg_lock);
+    return ret;
+}
+
+// Waits for PWR_RDY, then programs the current settings. The datasheet needs
+// no settling time between register writes, so nothing else sleeps here.
+static int max30100_init_chip(struct max30100_data *data)
+{
+    struct device *dev = &data->client->dev;
     int status;
-    int retries = 10;
+    int retries = 500;
+    int ret;
 
     while (retries--)
     {
-        status = max30100_read_reg(REG_INT_STATUS);
+        status = max30100_read_reg(data, REG_INT_STATUS);
         if (status < 0)
         {
-            pr_err("%s: max30100_read_reg() failed\n", THIS_MODULE->name);
+            dev_err(dev, "max30100_read_reg() failed\n");
             return status;
         }
-        if (status & 0x01)
+        if (status & INT_PWR_RDY)
         {
-            pr_info("%s status = 0x%x\n", THIS_MODULE->name, status);
+            dev_info(dev, "status = 0x%x\n", status);
             break;
         }
-        msleep(100);
+        usleep_range(2000, 2500);
     }
 
-    if (!(status & 0x01))
+    if (!(status & INT_PWR_RDY))
     {
-        pr_err("MAX30100: PWR_RDY not set\n");
+        dev_err(dev, "PWR_RDY not set\n");
         return -ENODEV;
     }
 
-    pr_info("MAX30100: chip ready, initializing...\n");
-    msleep(10);
+    mutex_lock(&data->cfg_lock);
+    data->chip_up = true;
+    ret = max30100_apply_config(data, &data->cfg);
+    mutex_unlock(&data->cfg_lock);
+    if (ret)
+    {
+        dev_err(dev, "configuration failed: %d\n", ret);
+        return ret;
+    }
+
+    dev_info(dev, "Initialization done (%u Hz, %u us)\n", data->cfg.sample_rate_hz, data->cfg.pulse_width_us);
+    return 0;
+}
+
+// Empties the chip FIFO so the pointers start from a known state
+static int max30100_fifo_reset(struct max30100_data *data)
+{
+    int ret;
+
+    ret = max30100_write_reg(data, REG_FIFO_WR_PTR, 0);
+    if (ret == 0)
+        ret = max30100_write_reg(data, REG_OVF_COUNTER, 0);
+    if (ret == 0)
+        ret = max30100_write_reg(data, REG_FIFO_RD_PTR, 0);
+    return ret;
+}
+
+// Returns the number of unread samples in the chip FIFO; *overflow tells whether samples were lost.
+// Equal pointers mean an empty FIFO or one holding FIFO_DEPTH samples; a_full (A_FULL seen in
+// INT_STATUS) tells it is the latter.
+static int max30100_fifo_count(struct max30100_data *data, bool a_full, bool *overflow)
+{
+    u8 ptrs[3]; // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR
+    int count, ret;
 
-    max30100_write_reg(REG_MODE_CONFIG, 0x03); // SPO2 mode
-    pr_info("Step 1 successful: SPO2 mode set.\n");
-    msleep(10);
+    if (data->removed)
+        return -ENODEV;
+    atomic_long_inc(&data->reg_reads);
+    ret = regmap_bulk_read(data->regmap, REG_FIFO_WR_PTR, ptrs, sizeof(ptrs));
+    if (ret < 0)
+        return ret;
 
-    max30100_write_reg(REG_SPO2_CONFIG, 0x5C); // 100Hz sample rate, 1600us pulse width
-    pr_info("Step 2 successful: SPO2 config set.\n");
-    msleep(10);
+    // A non-zero overflow counter means the FIFO is full and samples were lost
+    *overflow = ptrs[1] != 0;
+    if (*overflow)
+    {
+        data->dropped += ptrs[1];
+        data->overflows++;
+        return FIFO_DEPTH;
+    }
+    count = (ptrs[0] - ptrs[2]) & (FIFO_DEPTH - 1);
+    return count == 0 && a_full ? FIFO_DEPTH : count;
+}
 
-    max30100_write_reg(REG_LED_CONFIG, 0x59); // IR=24mA, Red=24mA
-    pr_info("Step 3 successful: LED current set.\n");
-    msleep(10);
+static size_t max30100_ring_bytes(void)
+{
+    return PAGE_SIZE + PAGE_ALIGN(MAX30100_RING_SLOTS * sizeof(struct max30100_record));
+}
 
-    pr_info("MAX30100: Initialization done\n");
+static int max30100_ring_alloc(struct max30100_data *data)
+{
+    data->ring = vmalloc_user(max30100_ring_bytes());
+    if (!data->ring)
+        return -ENOMEM;
+    data->ring->slots = MAX30100_RING_SLOTS;
+    data->ring->data_offset = PAGE_SIZE;
+    data->ring_slots = (void *)data->ring + PAGE_SIZE;
     return 0;
 }
 
+// True while an mmap() consumer owns the sample stream
+static bool max30100_ring_active(struct max30100_data *data)
+{
+    return atomic_read(&data->ring_maps) > 0;
+}
+
+static bool max30100_ring_empty(struct max30100_data *data)
+{
+    return READ_ONCE(data->ring->head) == smp_load_acquire(&data->ring->tail);
+}
+
+// Stores a record in the next free slot; the caller publishes head afterwards
+static bool max30100_ring_put(struct max30100_data *data, u32 *head, const struct max30100_record *rec)
+{
+    u32 tail = smp_load_acquire(&data->ring->tail);
+
+    if (*head - tail >= MAX30100_RING_SLOTS)
+    {
+        data->ring->overruns++;
+        return false;
+    }
+    data->ring_slots[*head & (MAX30100_RING_SLOTS - 1)] = *rec;
+    (*head)++;
+    return true;
+}
+
+// Returns the time of the oldest of count samples just found in the FIFO.
+// The newest one was taken when the chip raised INT or, when that is stale or
+// there is no IRQ, on average half a period before the pointers were read.
+// Timestamps stay on an evenly spaced grid that follows this estimate slowly;
+// the difference between the two is the jitter reported in debugfs.
+static u64 max30100_first_timestamp(struct max30100_data *data, int count, u64 read_ns, bool overflow)
+{
+    u64 period = READ_ONCE(data->sample_period_ns);
+    u64 ts_next = READ_ONCE(data->ts_next);
+    u64 irq_ns = data->irq_ns;
+    u64 newest, first, jitter;
+    s64 err;
+
+    data->irq_ns = 0;
+    if (irq_ns && read_ns - irq_ns < period)
+        newest = irq_ns;
+    else
+        newest = read_ns - period / 2;
+    first = newest - (count - 1) * period;
+
+    // After lost samples or without history the grid restarts at the estimate
+    if (overflow || !ts_next)
+        return first;
+
+    err = (s64)(first - ts_next);
+    jitter = err < 0 ? -err : err;
+    if (jitter > 4 * period)
+        return first;
+
+    data->jitter_sum_ns += jitter;
+    data->jitter_count++;
+    if (jitter > data->jitter_max_ns)
+        data->jitter_max_ns = jitter;
+    return ts_next + div_s64(err, 8);
+}
+
+// Samples the die temperature at temp_period_ns using the bus window of a
+// FIFO drain: one drain starts a conversion with a single MODE write, a later
+// one (29 ms on) reads TEMP_INTEGER/TEMP_FRACTION in one burst. No interrupt
+// or extra wakeup is involved. Called with bus_lock held.
+static void max30100_temp_step(struct max30100_data *data, u64 now_ns)
+{
+    u64 period = READ_ONCE(data->temp_period_ns);
+    u8 raw[2];
+    int ret;
+
+    if (data->temp_start_ns)
+    {
+        if (now_ns - data->temp_start_ns < TEMP_CONV_NS)
+            return;
+        data->temp_start_ns = 0;
+        atomic_long_inc(&data->reg_reads);
+        ret = regmap_bulk_read(data->regmap, REG_TEMP_INTEGER, raw, sizeof(raw));
+        if (ret)
+        {
+            dev_err(&data->client->dev, "temperature read failed: %d\n", ret);
+            return;
+        }
+        // Two's complement whole degrees plus 1/16 degC steps
+        data->temp = (s8)raw[0] * 16 + (raw[1] & 0x0F);
+        data->temp_valid = true;
+        return;
+    }
+
+    if (!period)
+    {
+        data->temp_valid = false;
+        return;
+    }
+    if (data->temp_last_ns && now_ns - data->temp_last_ns < period)
+        return;
+
+    // MODE is cached, write_bits forces the write even though TEMP_EN may still be set in the cache
+    atomic_long_inc(&data->reg_writes);
+    ret = regmap_write_bits(data->regmap, REG_MODE_CONFIG, MODE_TEMP_EN, MODE_TEMP_EN);
+    if (ret)
+        return;
+    data->temp_start_ns = now_ns;
+    data->temp_last_ns = now_ns;
+}
+
+// Moves every sample currently in the chip FIFO into the driver buffer; a_full is true when
+// INT_STATUS just reported A_FULL
+static int max30100_drain_fifo(struct max30100_data *data, bool a_full)
+{
+    struct max30100_record sample = {0};
+    bool to_ring = max30100_ring_active(data);
+    bool overflow = false;
+    u32 head = 0;
+    u64 period, read_ns;
+    int count, ret, i;
+    bool queued = false;
+
+    mutex_lock(&data->bus_lock);
+
+    count = max30100_fifo_count(data, a_full, &overflow);
+    read_ns = ktime_get_ns();
+    if (count <= 0)
+    {
+        ret = count;
+        goto out;
+    }
+
+    // FIFO_DATA does not auto-increment, so the whole burst is one register read
+    atomic_long_inc(&data->reg_reads);
+    ret = regmap_noinc_read(data->regmap, REG_FIFO_DATA, data->fifo_buf, count * FIFO_SAMPLE_SIZE);
+    if (ret)
+    {
+        dev_err(&data->client->dev, "FIFO read failed: %d\n", ret);
+        goto out;
+    }
+    max30100_temp_step(data, read_ns);
+
+    // Samples are one sample period apart, the last one being the newest
+    period = READ_ONCE(data->sample_period_ns);
+    sample.timestamp_ns = max30100_first_timestamp(data, count, read_ns, overflow);
+    if (overflow)
+        data->gap = true;
+    if (to_ring)
+        head = data->ring->head;
+    for (i = 0; i < count; i++)
+    {
+        u8 *raw = &data->fifo_buf[i * FIFO_SAMPLE_SIZE];
+        bool stored;
+
+        // Combine the received bytes into 16-bit values
+        sample.ir = ((u16)raw[0] << 8) | raw[1];
+        sample.red = ((u16)raw[2] << 8) | raw[3];
+        sample.flags = data->gap ? MAX30100_REC_GAP : 0;
+        if (data->temp_valid)
+        {
+            sample.flags |= MAX30100_REC_TEMP;
+            sample.temp = data->temp;
+        }
+
+        if (to_ring)
+        {
+            stored = max30100_ring_put(data, &head, &sample);
+        }
+        else
+        {
+            stored = kfifo_put(&data->samples, sample);
+            if (!stored)
+                data->dropped++;
+        }
+        data->gap = !stored;
+        queued |= stored;
+        sample.timestamp_ns += period;
+    }
+    if (to_ring)
+        smp_store_release(&data->ring->head, head);
+    WRITE_ONCE(data->ts_next, sample.timestamp_ns);
+    ret = count;
+
+out:
+    mutex_unlock(&data->bus_lock);
+    if (queued)
+        wake_up_interruptible(&data->wq);
+    return ret;
+}
+
+// Hard IRQ half: only notes when the chip raised INT, for the sample timestamps
+static irqreturn_t max30100_irq_handler(int irq, void *dev_id)
+{
+    struct max30100_data *data = dev_id;
+
+    data->irq_ns = ktime_get_ns();
+    return IRQ_WAKE_THREAD;
+}
+
+// Threaded IRQ handler: reading INT_STATUS acknowledges the interrupt
+static irqreturn_t max30100_irq_thread(int irq, void *dev_id)
+{
+    struct max30100_data *data = dev_id;
+    int status;
+
+    status = max30100_read_reg(data, REG_INT_STATUS);
+    if (status < 0)
+        return IRQ_NONE;
+    if (!(status & (INT_A_FULL | INT_SPO2_RDY)))
+        return IRQ_NONE;
+
+    max30100_drain_fifo(data, status & INT_A_FULL);
+    return IRQ_HANDLED;
+}
+
+// Polling mode: the I2C transfers sleep, so the timer only kicks the work item
+static enum hrtimer_restart max30100_poll_timer(struct hrtimer *timer)
+{
+    struct max30100_data *data = container_of(timer, struct max30100_data, poll_timer);
+
+    queue_work(system_highpri_wq, &data->poll_work);
+    hrtimer_forward_now(timer, ns_to_ktime(READ_ONCE(data->poll_period_ns)));
+    return HRTIMER_RESTART;
+}
+
+static void max30100_poll_work(struct work_struct *work)
+{
+    struct max30100_data *data = container_of(work, struct max30100_data, poll_work);
+
+    // No INT_STATUS to go by; polls come every POLL_WATERMARK samples, so equal pointers mean empty
+    max30100_drain_fifo(data, false);
+}
+
+static void max30100_start_polling(struct max30100_data *data)
+{
+    hrtimer_init(&data->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    data->poll_timer.function = max30100_poll_timer;
+    INIT_WORK(&data->poll_work, max30100_poll_work);
+    data->polled = true;
+    hrtimer_start(&data->poll_timer, ns_to_ktime(READ_ONCE(data->poll_period_ns)), HRTIMER_MODE_REL);
+}
+
+static void max30100_stop_polling(struct max30100_data *data)
+{
+    if (!data->polled)
+        return;
+    hrtimer_cancel(&data->poll_timer);
+    cancel_work_sync(&data->poll_work);
+}
+
+// Starts sampling: from the INT line if the board routes it, else from the poll timer
+static int max30100_start_sampling(struct max30100_data *data)
+{
+    struct i2c_client *client = data->client;
+    int ret;
+
+    // Start from an empty FIFO, then let the chip signal A_FULL/SPO2_RDY on its INT line
+    ret = max30100_fifo_reset(data);
+    if (ret < 0)
+        return ret;
+
+    if (client->irq <= 0)
+    {
+        max30100_start_polling(data);
+        dev_info(&client->dev, "no IRQ, polling the FIFO every %llu us\n", data->poll_period_ns / NSEC_PER_USEC);
+        return 0;
+    }
+
+    ret = devm_request_threaded_irq(&client->dev, client->irq, max30100_irq_handler, max30100_irq_thread,
+                                    IRQF_TRIGGER_FALLING | IRQF_ONESHOT, dev_name(&client->dev), data);
+    if (ret < 0)
+    {
+        dev_err(&client->dev, "request_threaded_irq(%d) failed: %d\n", client->irq, ret);
+        return ret;
+    }
+    data->irq_requested = true;
+    dev_info(&client->dev, "using IRQ %d\n", client->irq);
+    return max30100_write_reg(data, REG_INT_ENABLE, INT_A_FULL | INT_SPO2_RDY);
+}
+
+// Chip bring-up, queued by probe: waits for PWR_RDY (up to a second after
+// power-on), programs the settings and starts sampling. The device node
+// exists already; readers sleep until the first samples arrive.
+static void max30100_init_work(struct work_struct *work)
+{
+    struct max30100_data *data = container_of(work, struct max30100_data, init_work);
+    int ret;
+
+    ret = max30100_init_chip(data);
+    if (ret == 0)
+        ret = max30100_start_sampling(data);
+    if (ret < 0)
+    {
+        dev_err(&data->client->dev, "MAX30100 is not ready or failed to initialize.\n");
+        data->state = MAX30100_FAILED;
+        wake_up_interruptible_all(&data->wq);
+        return;
+    }
+    data->state = MAX30100_READY;
+}
+
+// Last reference gone: no file, mapping or bound device uses the state any more
+static void max30100_release(struct kref *kref)
+{
+    struct max30100_data *data = container_of(kref, struct max30100_data, kref);
+
+    vfree(data->ring);
+    put_device(&data->client->dev);
+    kfree(data);
+}
+
 // File Operations
 static struct file_operations max30100_fops = {
     .owner = THIS_MODULE,
     .read = max30100_read,
+    .poll = max30100_poll,
+    .unlocked_ioctl = max30100_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = max30100_mmap,
     .open = max30100_open,
     .release = max30100_close,
+    .llseek = no_llseek,
 };
 
 static int max30100_open(struct inode *inode, struct file *file)
 {
-    pr_info("max30100 device opened\n");
-    return 0;
+    struct max30100_data *data;
+    struct max30100_file *mf;
+
+    mutex_lock(&max30100_idr_lock);
+    data = idr_find(&max30100_idr, iminor(inode));
+    if (data)
+        kref_get(&data->kref);
+    mutex_unlock(&max30100_idr_lock);
+    if (!data)
+        return -ENODEV;
+
+    mf = kzalloc(sizeof(*mf), GFP_KERNEL);
+    if (!mf)
+    {
+        kref_put(&data->kref, max30100_release);
+        return -ENOMEM;
+    }
+    mf->data = data;
+    mf->format = MAX30100_FMT_TEXT;
+    file->private_data = mf;
+
+    dev_info(&data->client->dev, "device opened\n");
+    return stream_open(inode, file);
 }
 
+// A mapping holds the file, so the ring is not freed under an mmap() consumer
 static int max30100_close(struct inode *inode, struct file *pfile)
 {
-    pr_info("max30100 device closed\n");
+    struct max30100_file *mf = pfile->private_data;
+
+    // log first: the put may free the device state and the client reference
+    dev_info(&mf->data->client->dev, "device closed\n");
+    kref_put(&mf->data->kref, max30100_release);
+    kfree(mf);
     return 0;
 }
 
-// Reads raw IR and Red data from the FIFO and sends it to user space
-static ssize_t max30100_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+static long max30100_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct max30100_file *mf = file->private_data;
+    struct max30100_data *data = mf->data;
+    void __user *uarg = (void __user *)arg;
+    struct max30100_config cfg;
+    int format;
+
+    switch (cmd)
+    {
+    case MAX30100_IOC_SET_CONFIG:
+        if (copy_from_user(&cfg, uarg, sizeof(cfg)))
+            return -EFAULT;
+        return max30100_set_config(data, &cfg);
+    case MAX30100_IOC_GET_CONFIG:
+        mutex_lock(&data->cfg_lock);
+        cfg = data->cfg;
+        mutex_unlock(&data->cfg_lock);
+        if (copy_to_user(uarg, &cfg, sizeof(cfg)))
+            return -EFAULT;
+        return 0;
+    case MAX30100_IOC_SET_FORMAT:
+        if (get_user(format, (int __user *)uarg))
+            return -EFAULT;
+        if (format != MAX30100_FMT_TEXT && format != MAX30100_FMT_BINARY)
+            return -EINVAL;
+        mf->format = format;
+        return 0;
+    case MAX30100_IOC_GET_FORMAT:
+        return put_user(mf->format, (int __user *)uarg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+// Waits until the driver buffer holds a sample; returns with read_lock held on success.
+// The IRQ thread or, without an INT line, the poll timer fills the buffer.
+static int max30100_wait_samples(struct max30100_data *data, struct file *file)
 {
-    u8 data[4];
     int ret;
-    u16 ir, red;
-    char output[128];
+
+    for (;;)
+    {
+        if (mutex_lock_interruptible(&data->read_lock))
+            return -ERESTARTSYS;
+        if (!kfifo_is_empty(&data->samples))
+            return 0;
+        mutex_unlock(&data->read_lock);
+
+        if (data->removed)
+            return -ENODEV;
+        if (data->state == MAX30100_FAILED)
+            return -EIO;
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        // Also covers a chip still coming up: its first samples end the wait
+        ret = wait_event_interruptible(data->wq, !kfifo_is_empty(&data->samples) || data->removed ||
+                                                     data->state == MAX30100_FAILED);
+        if (ret)
+            return ret;
+    }
+}
+
+// Copies buffered samples as packed struct max30100_record entries
+static ssize_t max30100_read_binary(struct max30100_data *data, char __user *buf, size_t count)
+{
+    unsigned int copied;
+    int ret;
+
+    ret = kfifo_to_user(&data->samples, buf, count, &copied);
+    if (ret)
+        return ret;
+    return copied;
+}
+
+// Copies buffered IR and Red samples to user space, one "ir red" line per sample
+static ssize_t max30100_read_text(struct max30100_data *data, char __user *buf, size_t count)
+{
+    struct max30100_record sample;
+    char output[32];
+    ssize_t copied = 0;
     int len;
 
-    // Use a combined I2C transfer to write the register address and then read the data
-    struct i2c_msg msgs[2] = {
-        {
-            .addr = max30100_client->addr,
-            .flags = 0, // Write
-            .len = 1,
-            .buf = (u8[]){REG_FIFO_DATA},
-        },
+    // Hand out as many whole lines as fit into the user buffer
+    while (kfifo_peek(&data->samples, &sample))
+    {
+        len = snprintf(output, sizeof(output), "%u %u\n", sample.ir, sample.red);
+        if (copied + len > count)
+            break;
+        if (copy_to_user(buf + copied, output, len))
         {
-            .addr = max30100_client->addr,
-            .flags = I2C_M_RD, // Read
-            .len = 4,
-            .buf = data,
-        },
-    };
+            if (!copied)
+                copied = -EFAULT;
+            break;
+        }
+        kfifo_skip(&data->samples);
+        copied += len;
+    }
+    return copied;
+}
+
+// Read latency: how long the oldest sample handed out waited since the chip took it
+static void max30100_account_latency(struct max30100_data *data, u64 sample_ns)
+{
+    u64 latency = ktime_get_ns() - sample_ns;
+
+    data->latency_sum_ns += latency;
+    data->latency_count++;
+    if (latency > data->latency_max_ns)
+        data->latency_max_ns = latency;
+}
+
+static ssize_t max30100_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+{
+    struct max30100_file *mf = file->private_data;
+    struct max30100_data *data = mf->data;
+    struct max30100_record oldest;
+    bool have_oldest;
+    ssize_t copied;
+    int ret;
 
-    ret = i2c_transfer(max30100_client->adapter, msgs, 2);
-    if (ret != 2)
+    if (mf->format == MAX30100_FMT_BINARY && count < sizeof(struct max30100_record))
+        return -EINVAL;
+
+    ret = max30100_wait_samples(data, file);
+    if (ret)
+        return ret;
+
+    have_oldest = kfifo_peek(&data->samples, &oldest);
+    if (mf->format == MAX30100_FMT_BINARY)
+        copied = max30100_read_binary(data, buf, count);
+    else
+        copied = max30100_read_text(data, buf, count);
+    if (copied > 0 && have_oldest)
+        max30100_account_latency(data, oldest.timestamp_ns);
+
+    mutex_unlock(&data->read_lock);
+
+    // The user buffer cannot hold even one sample
+    if (!copied)
+        return -EINVAL;
+    return copied;
+}
+
+static void max30100_vm_open(struct vm_area_struct *vma)
+{
+    struct max30100_data *data = vma->vm_private_data;
+
+    atomic_inc(&data->ring_maps);
+}
+
+static void max30100_vm_close(struct vm_area_struct *vma)
+{
+    struct max30100_data *data = vma->vm_private_data;
+
+    atomic_dec(&data->ring_maps);
+}
+
+static const struct vm_operations_struct max30100_vm_ops = {
+    .open = max30100_vm_open,
+    .close = max30100_vm_close,
+};
+
+// Maps the shared sample ring; only one consumer may have it mapped at a time
+static int max30100_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct max30100_file *mf = file->private_data;
+    struct max30100_data *data = mf->data;
+    unsigned long size = vma->vm_end - vma->vm_start;
+    int ret;
+
+    if (vma->vm_pgoff != 0 || size > max30100_ring_bytes())
+        return -EINVAL;
+
+    mutex_lock(&data->ring_lock);
+    if (data->removed)
+    {
+        ret = -ENODEV;
+        goto out;
+    }
+    if (atomic_read(&data->ring_maps))
     {
-        pr_err("MAX30100: I2C transfer failed: %d\n", ret);
-        return -EIO;
+        ret = -EBUSY;
+        goto out;
     }
 
-    // Combine the received bytes into 16-bit values
-    ir = ((u16)data[0] << 8) | data[1];
-    red = ((u16)data[2] << 8) | data[3];
+    ret = remap_vmalloc_range(vma, data->ring, 0);
+    if (ret)
+        goto out;
 
-    // Format the raw IR and RED data into a string for user space
-    len = snprintf(output, sizeof(output), "%u %u\n", ir, red);
+    // The new consumer starts with an empty ring
+    WRITE_ONCE(data->ring->tail, READ_ONCE(data->ring->head));
+    vma->vm_ops = &max30100_vm_ops;
+    vma->vm_private_data = data;
+    atomic_inc(&data->ring_maps);
 
-    // Copy the raw data string to the user buffer
-    if (copy_to_user(buf, output, len))
-        return -EFAULT;
+out:
+    mutex_unlock(&data->ring_lock);
+    return ret;
+}
+
+// True when the consumer of this stream (ring or read()) has samples waiting
+static bool max30100_data_ready(struct max30100_data *data)
+{
+    if (max30100_ring_active(data))
+        return !max30100_ring_empty(data);
+    return !kfifo_is_empty(&data->samples);
+}
+
+static __poll_t max30100_poll(struct file *file, poll_table *wait)
+{
+    struct max30100_file *mf = file->private_data;
+    struct max30100_data *data = mf->data;
+
+    poll_wait(file, &data->wq, wait);
+
+    if (max30100_data_ready(data))
+        return EPOLLIN | EPOLLRDNORM;
+    if (data->removed)
+        return EPOLLHUP | EPOLLERR;
+    if (data->state == MAX30100_FAILED)
+        return EPOLLERR;
+    return 0;
+}
+
+// sysfs configuration attributes, one per struct max30100_config field
+static ssize_t max30100_config_show(struct device *dev, size_t offset, char *buf)
+{
+    struct max30100_data *data = dev_get_drvdata(dev);
+    u32 val;
 
-    return len;
+    mutex_lock(&data->cfg_lock);
+    val = *(u32 *)((u8 *)&data->cfg + offset);
+    mutex_unlock(&data->cfg_lock);
+    return sysfs_emit(buf, "%u\n", val);
 }
 
+static ssize_t max30100_config_store(struct device *dev, size_t offset, const char *buf, size_t count)
+{
+    struct max30100_data *data = dev_get_drvdata(dev);
+    struct max30100_config cfg;
+    unsigned int val;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret)
+        return ret;
+
+    mutex_lock(&data->cfg_lock);
+    cfg = data->cfg;
+    *(u32 *)((u8 *)&cfg + offset) = val;
+    ret = max30100_apply_config(data, &cfg);
+    mutex_unlock(&data->cfg_lock);
+    return ret ? ret : count;
+}
+
+#define MAX30100_CONFIG_ATTR(_field)                                                                 \
+    static ssize_t _field##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+    {                                                                                                \
+        return max30100_config_show(dev, offsetof(struct max30100_config, _field), buf);            \
+    }                                                                                                \
+    static ssize_t _field##_store(struct device *dev, struct device_attribute *attr, const char *buf, \
+                                  size_t count)                                                      \
+    {                                                                                                \
+        return max30100_config_store(dev, offsetof(struct max30100_config, _field), buf, count);    \
+    }                                                                                                \
+    static DEVICE_ATTR_RW(_field)
+
+MAX30100_CONFIG_ATTR(sample_rate_hz);
+MAX30100_CONFIG_ATTR(pulse_width_us);
+MAX30100_CONFIG_ATTR(ir_current_ua);
+MAX30100_CONFIG_ATTR(red_current_ua);
+MAX30100_CONFIG_ATTR(temp_period_ms);
+
+// mode is shown and set as "hr" or "spo2"
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct max30100_data *data = dev_get_drvdata(dev);
+    u32 mode;
+
+    mutex_lock(&data->cfg_lock);
+    mode = data->cfg.mode;
+    mutex_unlock(&data->cfg_lock);
+    return sysfs_emit(buf, "%s\n", mode == MAX30100_MODE_HR ? "hr" : "spo2");
+}
+
+static ssize_t mode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct max30100_data *data = dev_get_drvdata(dev);
+    struct max30100_config cfg;
+    int ret;
+
+    mutex_lock(&data->cfg_lock);
+    cfg = data->cfg;
+    if (sysfs_streq(buf, "hr"))
+        cfg.mode = MAX30100_MODE_HR;
+    else if (sysfs_streq(buf, "spo2"))
+        cfg.mode = MAX30100_MODE_SPO2;
+    else
+        cfg.mode = 0; // rejected by max30100_encode_config()
+    ret = max30100_apply_config(data, &cfg);
+    mutex_unlock(&data->cfg_lock);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(mode);
+
+static struct attribute *max30100_attrs[] = {
+    &dev_attr_mode.attr,
+    &dev_attr_sample_rate_hz.attr,
+    &dev_attr_pulse_width_us.attr,
+    &dev_attr_ir_current_ua.attr,
+    &dev_attr_red_current_ua.attr,
+    &dev_attr_temp_period_ms.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(max30100);
+
+// debugfs: register accesses the driver made versus I2C transactions they cost
+static int max30100_stats_show(struct seq_file *s, void *unused)
+{
+    struct max30100_data *data = s->private;
+    long reg_reads = atomic_long_read(&data->reg_reads);
+    long reg_writes = atomic_long_read(&data->reg_writes);
+    long bus_reads = atomic_long_read(&data->bus_reads);
+    long bus_writes = atomic_long_read(&data->bus_writes);
+
+    seq_printf(s, "reg_reads: %ld\n", reg_reads);
+    seq_printf(s, "reg_writes: %ld\n", reg_writes);
+    seq_printf(s, "bus_reads: %ld\n", bus_reads);
+    seq_printf(s, "bus_writes: %ld\n", bus_writes);
+    seq_printf(s, "bus_reads_saved: %ld\n", reg_reads - bus_reads);
+    seq_printf(s, "bus_writes_saved: %ld\n", reg_writes - bus_writes);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(max30100_stats);
+
+// debugfs: sample loss, timestamp jitter against the sample grid and read latency
+static int max30100_timing_show(struct seq_file *s, void *unused)
+{
+    struct max30100_data *data = s->private;
+
+    seq_printf(s, "sample_period_ns: %llu\n", data->sample_period_ns);
+    seq_printf(s, "overflows: %llu\n", data->overflows);
+    seq_printf(s, "samples_dropped: %lu\n", data->dropped);
+    seq_printf(s, "jitter_mean_ns: %llu\n",
+               data->jitter_count ? div64_u64(data->jitter_sum_ns, data->jitter_count) : 0);
+    seq_printf(s, "jitter_max_ns: %llu\n", data->jitter_max_ns);
+    seq_printf(s, "read_latency_mean_ns: %llu\n",
+               data->latency_count ? div64_u64(data->latency_sum_ns, data->latency_count) : 0);
+    seq_printf(s, "read_latency_max_ns: %llu\n", data->latency_max_ns);
+    if (data->temp_valid)
+        seq_printf(s, "temp_mdegc: %d\n", data->temp * 1000 / 16);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(max30100_timing);
+
 // I2C Driver Core
 static int max30100_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
     int ret;
+    struct max30100_data *data;
     struct device *max30100_device;
+    dev_t devt;
 
-    // Set the global client pointer for helper functions
-    max30100_client = client;
+    data = kzalloc(sizeof(*data), GFP_KERNEL);
+    if (!data)
+        return -ENOMEM;
+    kref_init(&data->kref);
+    data->client = client;
+    get_device(&client->dev); // messages from files still open after remove name the device
+    data->cfg = max30100_default_cfg;
+    INIT_KFIFO(data->samples);
+    init_waitqueue_head(&data->wq);
+    mutex_init(&data->bus_lock);
+    mutex_init(&data->read_lock);
+    mutex_init(&data->ring_lock);
+    mutex_init(&data->cfg_lock);
+    atomic_set(&data->ring_maps, 0);
+    INIT_WORK(&data->init_work, max30100_init_work);
+    i2c_set_clientdata(client, data);
 
-    // Initialize the chip
-    ret = max30100_init_chip();
-    if (ret < 0)
+    data->regmap = devm_regmap_init(&client->dev, &max30100_regmap_bus, data, &max30100_regmap_config);
+    if (IS_ERR(data->regmap))
     {
-        pr_err("MAX30100 is not ready or failed to initialize.\n");
-        return ret;
+        dev_err(&client->dev, "regmap init failed\n");
+        ret = PTR_ERR(data->regmap);
+        goto err_put;
     }
 
-    // Create character device
-    ret = alloc_chrdev_region(&devno, 0, 1, "max30100_dev");
+    ret = max30100_ring_alloc(data);
     if (ret < 0)
-        return ret;
+        goto err_put;
 
-    max30100_class = class_create(THIS_MODULE, "max30100_class");
-    if (IS_ERR(max30100_class))
+    // Pick a free minor number for this sensor
+    mutex_lock(&max30100_idr_lock);
+    ret = idr_alloc(&max30100_idr, data, 0, MAX30100_MAX_DEVICES, GFP_KERNEL);
+    mutex_unlock(&max30100_idr_lock);
+    if (ret < 0)
+        goto err_put;
+    data->minor = ret;
+    devt = MKDEV(MAJOR(devno), data->minor);
+
+    // Initialize and add the cdev
+    data->cdev = cdev_alloc();
+    if (!data->cdev)
     {
-        unregister_chrdev_region(devno, 1);
-        return PTR_ERR(max30100_class);
+        ret = -ENOMEM;
+        goto err_idr;
     }
-
-    max30100_device = device_create(max30100_class, &client->dev, devno, NULL, "max30100");
-    if (IS_ERR(max30100_device))
+    data->cdev->ops = &max30100_fops;
+    data->cdev->owner = THIS_MODULE;
+    ret = cdev_add(data->cdev, devt, 1);
+    if (ret < 0)
     {
-        class_destroy(max30100_class);
-        unregister_chrdev_region(devno, 1);
-        return PTR_ERR(max30100_device);
+        kobject_put(&data->cdev->kobj);
+        goto err_idr;
     }
 
-    // Initialize and add the cdev
-    cdev_init(&max30100_cdev, &max30100_fops);
-    ret = cdev_add(&max30100_cdev, devno, 1);
-    if (ret < 0)
+    max30100_device = device_create_with_groups(max30100_class, &client->dev, devt, data, max30100_groups,
+                                                "max30100-%d", data->minor);
+    if (IS_ERR(max30100_device))
     {
-        device_destroy(max30100_class, devno);
-        class_destroy(max30100_class);
-        unregister_chrdev_region(devno, 1);
-        return ret;
+        ret = PTR_ERR(max30100_device);
+        goto err_cdev;
     }
 
-    pr_info("MAX30100 driver loaded and device created.\n");
+    data->debugfs = debugfs_create_dir(dev_name(&client->dev), max30100_debugfs_root);
+    debugfs_create_file("regmap_stats", 0444, data->debugfs, data, &max30100_stats_fops);
+    debugfs_create_file("timing", 0444, data->debugfs, data, &max30100_timing_fops);
+
+    // The chip may need up to a second to power up; do not hold up boot for it
+    queue_work(system_long_wq, &data->init_work);
+
+    dev_info(&client->dev, "MAX30100 driver loaded and device max30100-%d created.\n", data->minor);
     return 0;
+
+err_cdev:
+    cdev_del(data->cdev);
+err_idr:
+    mutex_lock(&max30100_idr_lock);
+    idr_remove(&max30100_idr, data->minor);
+    mutex_unlock(&max30100_idr_lock);
+err_put:
+    kref_put(&data->kref, max30100_release);
+    return ret;
 }
 
 static int max30100_remove(struct i2c_client *client)
 {
-    cdev_del(&max30100_cdev);
-    device_destroy(max30100_class, devno);
-    class_destroy(max30100_class);
-    unregister_chrdev_region(devno, 1);
-    pr_info("MAX30100 driver removed.\n");
+    struct max30100_data *data = i2c_get_clientdata(client);
+
+    cancel_work_sync(&data->init_work);
+    if (data->irq_requested)
+        devm_free_irq(&client->dev, client->irq, data);
+    max30100_stop_polling(data);
+    max30100_write_reg(data, REG_INT_ENABLE, 0);
+    debugfs_remove_recursive(data->debugfs);
+
+    // No new opens from here on; files already open keep their reference
+    mutex_lock(&max30100_idr_lock);
+    idr_remove(&max30100_idr, data->minor);
+    mutex_unlock(&max30100_idr_lock);
+    device_destroy(max30100_class, MKDEV(MAJOR(devno), data->minor));
+    cdev_del(data->cdev);
+
+    // Make those files fail instead of touching the chip, and wake any sleepers
+    mutex_lock(&data->bus_lock);
+    mutex_lock(&data->cfg_lock);
+    mutex_lock(&data->ring_lock);
+    data->removed = true;
+    mutex_unlock(&data->ring_lock);
+    mutex_unlock(&data->cfg_lock);
+    mutex_unlock(&data->bus_lock);
+    wake_up_interruptible_all(&data->wq);
+
+    if (data->dropped)
+        dev_info(&client->dev, "%lu samples dropped\n", data->dropped);
+    kref_put(&data->kref, max30100_release);
+    dev_info(&client->dev, "MAX30100 driver removed.\n");
     return 0;
 }
 
@@ -241,13 +1336,53 @@ static struct i2c_driver max30100_driver = {
     .driver = {
         .name = I2C_SLAVE_NAME,
         .of_match_table = of_match_ptr(max30100_of_match),
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS,
     },
     .probe = max30100_probe,
     .remove = max30100_remove,
     .id_table = max30100_id,
 };
 
-module_i2c_driver(max30100_driver);
+// Module init: one device number region and class shared by every sensor
+static int __init max30100_init(void)
+{
+    int ret;
+
+    ret = alloc_chrdev_region(&devno, 0, MAX30100_MAX_DEVICES, "max30100_dev");
+    if (ret < 0)
+        return ret;
+
+    max30100_class = class_create(THIS_MODULE, "max30100_class");
+    if (IS_ERR(max30100_class))
+    {
+        unregister_chrdev_region(devno, MAX30100_MAX_DEVICES);
+        return PTR_ERR(max30100_class);
+    }
+
+    max30100_debugfs_root = debugfs_create_dir(I2C_SLAVE_NAME, NULL);
+
+    ret = i2c_add_driver(&max30100_driver);
+    if (ret < 0)
+    {
+        debugfs_remove_recursive(max30100_debugfs_root);
+        class_destroy(max30100_class);
+        unregister_chrdev_region(devno, MAX30100_MAX_DEVICES);
+        return ret;
+    }
+    return 0;
+}
+
+static void __exit max30100_exit(void)
+{
+    i2c_del_driver(&max30100_driver);
+    debugfs_remove_recursive(max30100_debugfs_root);
+    class_destroy(max30100_class);
+    unregister_chrdev_region(devno, MAX30100_MAX_DEVICES);
+    idr_destroy(&max30100_idr);
+}
+
+module_init(max30100_init);
+module_exit(max30100_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Varad Kalekar,Satyam Patil,Sourabh Divate,Srushti Nakate");
@@ -0,0 +1,52 @@
+/*
+ * Biquad design shared by the PPG filters (max30100_spo2.c, ppg_filterbank.c)
+ *
+ * Header only so each user keeps a single translation unit to build.
+ */
+
+#ifndef PPG_BIQUAD_H
+#define PPG_BIQUAD_H
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_SQRT1_2
+#define M_SQRT1_2 0.70710678118654752440
+#endif
+
+/* Coefficients of one second order section, normalised to a0 = 1 */
+typedef struct {
+    float b0, b1, b2;
+    float a1, a2;
+} ppg_biquad_coeffs;
+
+/**
+ * @brief Butterworth (Q = 1/sqrt(2)) low or high pass section, RBJ cookbook
+ *
+ * @param c Coefficients to fill
+ * @param cutoff_hz Corner frequency
+ * @param sample_rate_hz Sample rate
+ * @param high_pass Non-zero for a high pass, zero for a low pass
+ */
+static inline void ppg_biquad_design(ppg_biquad_coeffs *c, float cutoff_hz, float sample_rate_hz, int high_pass)
+{
+    double w0 = 2.0 * M_PI * cutoff_hz / sample_rate_hz;
+    double cs = cos(w0);
+    double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+    double a0 = 1.0 + alpha;
+
+    if (high_pass) {
+        c->b0 = (float)((1.0 + cs) / 2.0 / a0);
+        c->b1 = (float)(-(1.0 + cs) / a0);
+    } else {
+        c->b0 = (float)((1.0 - cs) / 2.0 / a0);
+        c->b1 = (float)((1.0 - cs) / a0);
+    }
+    c->b2 = c->b0;
+    c->a1 = (float)(-2.0 * cs / a0);
+    c->a2 = (float)((1.0 - alpha) / a0);
+}
+
+#endif // PPG_BIQUAD_H
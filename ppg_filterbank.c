@@ -0,0 +1,326 @@
+/*
+ * Multi-channel PPG filter bank, AVX2 and scalar kernels
+ *
+ * Both kernels walk the channels in groups of PPG_FB_LANES and, within a
+ * group, run every sample of the block through the whole cascade while the
+ * filter state stays in registers. The state is only loaded and stored once
+ * per block and group. Each kernel is instantiated per stage count so no
+ * per-sample loop over the stages is left.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ppg_filterbank.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PPG_FB_HAVE_AVX2 1
+#endif
+
+void ppg_fb_design(ppg_fb_coeffs *c, float cutoff_hz, float sample_rate_hz, int high_pass)
+{
+    ppg_biquad_design(c, cutoff_hz, sample_rate_hz, high_pass);
+}
+
+int ppg_fb_init(ppg_filterbank *fb, int channels, const ppg_fb_coeffs *stages, int nstages, int ma_len)
+{
+    size_t floats, bytes;
+    float *p;
+    int s;
+
+    memset(fb, 0, sizeof(*fb));
+    if (channels <= 0 || nstages < 0 || nstages > PPG_FB_MAX_STAGES || ma_len < 0)
+        return -1;
+
+    fb->channels = channels;
+    fb->stride = (channels + PPG_FB_LANES - 1) / PPG_FB_LANES * PPG_FB_LANES;
+    fb->nstages = nstages;
+    fb->ma_len = ma_len > 1 ? ma_len : 0;
+    memcpy(fb->coeffs, stages, nstages * sizeof(*stages));
+
+    // z1/z2 per stage, moving average history and running sums, 32 byte aligned rows
+    floats = (size_t)fb->stride * (2 * nstages + fb->ma_len + 1);
+    bytes = (floats * sizeof(float) + 31) & ~(size_t)31;
+    fb->mem = aligned_alloc(32, bytes);
+    if (!fb->mem)
+        return -1;
+    memset(fb->mem, 0, bytes);
+
+    p = fb->mem;
+    for (s = 0; s < nstages; s++) {
+        fb->z1[s] = p;
+        p += fb->stride;
+        fb->z2[s] = p;
+        p += fb->stride;
+    }
+    fb->ma_sum = p;
+    p += fb->stride;
+    fb->ma_hist = p;
+
+#ifdef PPG_FB_HAVE_AVX2
+    __builtin_cpu_init();
+    fb->use_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return 0;
+}
+
+void ppg_fb_free(ppg_filterbank *fb)
+{
+    free(fb->mem);
+    fb->mem = NULL;
+}
+
+/*
+ * Running sums are updated incrementally; rebuild one group's sums from the
+ * history each time the ring wraps so float rounding cannot accumulate.
+ */
+static void ma_resum(ppg_filterbank *fb, int c)
+{
+    int i, l;
+
+    for (l = 0; l < PPG_FB_LANES; l++)
+        fb->ma_sum[c + l] = 0.0f;
+    for (i = 0; i < fb->ma_len; i++)
+        for (l = 0; l < PPG_FB_LANES; l++)
+            fb->ma_sum[c + l] += fb->ma_hist[(size_t)i * fb->stride + c + l];
+}
+
+static inline __attribute__((always_inline)) void scalar_kernel(ppg_filterbank *fb, const float *in, float *out,
+                                                                int nsamples, const int nstages)
+{
+    const int stride = fb->stride;
+    const float inv_len = fb->ma_len ? 1.0f / fb->ma_len : 1.0f;
+    float z1[PPG_FB_MAX_STAGES][PPG_FB_LANES], z2[PPG_FB_MAX_STAGES][PPG_FB_LANES];
+    float x[PPG_FB_LANES];
+    int c, n, s, l, pos;
+
+    for (c = 0; c < stride; c += PPG_FB_LANES) {
+        for (s = 0; s < nstages; s++) {
+            memcpy(z1[s], &fb->z1[s][c], sizeof(z1[s]));
+            memcpy(z2[s], &fb->z2[s][c], sizeof(z2[s]));
+        }
+        pos = fb->ma_pos;
+
+        for (n = 0; n < nsamples; n++) {
+            memcpy(x, &in[(size_t)n * stride + c], sizeof(x));
+
+            for (s = 0; s < nstages; s++) {
+                const ppg_fb_coeffs *k = &fb->coeffs[s];
+
+                for (l = 0; l < PPG_FB_LANES; l++) {
+                    float y = k->b0 * x[l] + z1[s][l];
+
+                    z1[s][l] = k->b1 * x[l] - k->a1 * y + z2[s][l];
+                    z2[s][l] = k->b2 * x[l] - k->a2 * y;
+                    x[l] = y;
+                }
+            }
+
+            if (fb->ma_len) {
+                float *h = &fb->ma_hist[(size_t)pos * stride + c];
+                float *sum = &fb->ma_sum[c];
+
+                for (l = 0; l < PPG_FB_LANES; l++) {
+                    sum[l] += x[l] - h[l];
+                    h[l] = x[l];
+                    x[l] = sum[l] * inv_len;
+                }
+                if (++pos == fb->ma_len) {
+                    pos = 0;
+                    ma_resum(fb, c);
+                }
+            }
+
+            memcpy(&out[(size_t)n * stride + c], x, sizeof(x));
+        }
+
+        for (s = 0; s < nstages; s++) {
+            memcpy(&fb->z1[s][c], z1[s], sizeof(z1[s]));
+            memcpy(&fb->z2[s][c], z2[s], sizeof(z2[s]));
+        }
+    }
+    if (fb->ma_len)
+        fb->ma_pos = (fb->ma_pos + nsamples) % fb->ma_len;
+}
+
+static void process_scalar(ppg_filterbank *fb, const float *in, float *out, int nsamples)
+{
+    switch (fb->nstages) {
+    case 0:
+        scalar_kernel(fb, in, out, nsamples, 0);
+        break;
+    case 1:
+        scalar_kernel(fb, in, out, nsamples, 1);
+        break;
+    case 2:
+        scalar_kernel(fb, in, out, nsamples, 2);
+        break;
+    case 3:
+        scalar_kernel(fb, in, out, nsamples, 3);
+        break;
+    default:
+        scalar_kernel(fb, in, out, nsamples, PPG_FB_MAX_STAGES);
+        break;
+    }
+}
+
+#ifdef PPG_FB_HAVE_AVX2
+/* One cascade stage for 8 channels; kept in named locals so it lives in registers */
+struct avx2_stage {
+    __m256 b0, b1, b2, a1, a2;
+    __m256 z1, z2;
+};
+
+static inline __attribute__((always_inline, target("avx2,fma"))) void avx2_stage_load(struct avx2_stage *st,
+                                                                                       const ppg_filterbank *fb,
+                                                                                       int s, int c)
+{
+    st->b0 = _mm256_set1_ps(fb->coeffs[s].b0);
+    st->b1 = _mm256_set1_ps(fb->coeffs[s].b1);
+    st->b2 = _mm256_set1_ps(fb->coeffs[s].b2);
+    st->a1 = _mm256_set1_ps(fb->coeffs[s].a1);
+    st->a2 = _mm256_set1_ps(fb->coeffs[s].a2);
+    st->z1 = _mm256_load_ps(&fb->z1[s][c]);
+    st->z2 = _mm256_load_ps(&fb->z2[s][c]);
+}
+
+static inline __attribute__((always_inline, target("avx2,fma"))) void avx2_stage_store(const struct avx2_stage *st,
+                                                                                        ppg_filterbank *fb, int s,
+                                                                                        int c)
+{
+    _mm256_store_ps(&fb->z1[s][c], st->z1);
+    _mm256_store_ps(&fb->z2[s][c], st->z2);
+}
+
+// Transposed direct form II: y = b0 x + z1, z1 = b1 x - a1 y + z2, z2 = b2 x - a2 y
+static inline __attribute__((always_inline, target("avx2,fma"))) __m256 avx2_stage_run(struct avx2_stage *st,
+                                                                                        __m256 x)
+{
+    __m256 y = _mm256_fmadd_ps(st->b0, x, st->z1);
+
+    st->z1 = _mm256_fmadd_ps(st->b1, x, _mm256_fnmadd_ps(st->a1, y, st->z2));
+    st->z2 = _mm256_fnmadd_ps(st->a2, y, _mm256_mul_ps(st->b2, x));
+    return y;
+}
+
+// ma_resum() for one group, kept in AVX code to avoid AVX/SSE transitions in the loop
+static inline __attribute__((always_inline, target("avx2,fma"))) void avx2_ma_resum(ppg_filterbank *fb, int c)
+{
+    __m256 sum = _mm256_setzero_ps();
+    int i;
+
+    for (i = 0; i < fb->ma_len; i++)
+        sum = _mm256_add_ps(sum, _mm256_load_ps(&fb->ma_hist[(size_t)i * fb->stride + c]));
+    _mm256_store_ps(&fb->ma_sum[c], sum);
+}
+
+static inline __attribute__((always_inline, target("avx2,fma"))) void avx2_kernel(ppg_filterbank *fb,
+                                                                                   const float *in, float *out,
+                                                                                   int nsamples, const int nstages)
+{
+    const int stride = fb->stride;
+    const __m256 inv_len = _mm256_set1_ps(fb->ma_len ? 1.0f / fb->ma_len : 1.0f);
+    struct avx2_stage st0, st1, st2, st3;
+    int c, n, pos;
+
+    for (c = 0; c < stride; c += PPG_FB_LANES) {
+        if (nstages > 0)
+            avx2_stage_load(&st0, fb, 0, c);
+        if (nstages > 1)
+            avx2_stage_load(&st1, fb, 1, c);
+        if (nstages > 2)
+            avx2_stage_load(&st2, fb, 2, c);
+        if (nstages > 3)
+            avx2_stage_load(&st3, fb, 3, c);
+        pos = fb->ma_pos;
+
+        for (n = 0; n < nsamples; n++) {
+            __m256 x = _mm256_loadu_ps(&in[(size_t)n * stride + c]);
+
+            if (nstages > 0)
+                x = avx2_stage_run(&st0, x);
+            if (nstages > 1)
+                x = avx2_stage_run(&st1, x);
+            if (nstages > 2)
+                x = avx2_stage_run(&st2, x);
+            if (nstages > 3)
+                x = avx2_stage_run(&st3, x);
+
+            if (fb->ma_len) {
+                float *h = &fb->ma_hist[(size_t)pos * stride + c];
+                __m256 sum = _mm256_load_ps(&fb->ma_sum[c]);
+
+                sum = _mm256_add_ps(sum, _mm256_sub_ps(x, _mm256_load_ps(h)));
+                _mm256_store_ps(h, x);
+                _mm256_store_ps(&fb->ma_sum[c], sum);
+                x = _mm256_mul_ps(sum, inv_len);
+                if (++pos == fb->ma_len) {
+                    pos = 0;
+                    avx2_ma_resum(fb, c);
+                }
+            }
+
+            _mm256_storeu_ps(&out[(size_t)n * stride + c], x);
+        }
+
+        if (nstages > 0)
+            avx2_stage_store(&st0, fb, 0, c);
+        if (nstages > 1)
+            avx2_stage_store(&st1, fb, 1, c);
+        if (nstages > 2)
+            avx2_stage_store(&st2, fb, 2, c);
+        if (nstages > 3)
+            avx2_stage_store(&st3, fb, 3, c);
+    }
+    if (fb->ma_len)
+        fb->ma_pos = (fb->ma_pos + nsamples) % fb->ma_len;
+}
+
+__attribute__((target("avx2,fma"))) static void process_avx2(ppg_filterbank *fb, const float *in, float *out,
+                                                             int nsamples)
+{
+    switch (fb->nstages) {
+    case 0:
+        avx2_kernel(fb, in, out, nsamples, 0);
+        break;
+    case 1:
+        avx2_kernel(fb, in, out, nsamples, 1);
+        break;
+    case 2:
+        avx2_kernel(fb, in, out, nsamples, 2);
+        break;
+    case 3:
+        avx2_kernel(fb, in, out, nsamples, 3);
+        break;
+    default:
+        avx2_kernel(fb, in, out, nsamples, PPG_FB_MAX_STAGES);
+        break;
+    }
+}
+#endif
+
+void ppg_fb_process(ppg_filterbank *fb, const float *in, float *out, int nsamples)
+{
+#ifdef PPG_FB_HAVE_AVX2
+    if (fb->use_avx2) {
+        process_avx2(fb, in, out, nsamples);
+        return;
+    }
+#endif
+    process_scalar(fb, in, out, nsamples);
+}
+
+void ppg_fb_put_records(const ppg_filterbank *fb, float *block, int sensor, const struct max30100_record *recs,
+                        int nrecs)
+{
+    float *dst = block + 2 * sensor;
+    int n;
+
+    for (n = 0; n < nrecs; n++) {
+        dst[0] = recs[n].ir;
+        dst[1] = recs[n].red;
+        dst += fb->stride;
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * Multi-channel PPG filter bank
+ *
+ * Runs the same biquad cascade followed by a moving average over many
+ * channels at once. Sample blocks are channel interleaved: sample n of
+ * channel c is at block[n * fb->stride + c]. A gateway with several
+ * MAX30100 sensors typically uses two channels per sensor (IR and Red)
+ * and fills blocks straight from the driver's binary reads with
+ * ppg_fb_put_records().
+ *
+ * Channels are processed 8 at a time, with AVX2 when the CPU has it and
+ * a scalar loop otherwise.
+ */
+
+#ifndef PPG_FILTERBANK_H
+#define PPG_FILTERBANK_H
+
+#include <stddef.h>
+
+#include "max30100.h"
+#include "ppg_biquad.h"
+
+#define PPG_FB_MAX_STAGES 4
+#define PPG_FB_LANES 8 // channels per vector, stride is a multiple of this
+
+typedef ppg_biquad_coeffs ppg_fb_coeffs;
+
+typedef struct {
+    int channels;
+    int stride; // channels rounded up to PPG_FB_LANES
+    int nstages;
+    ppg_fb_coeffs coeffs[PPG_FB_MAX_STAGES];
+    float *z1[PPG_FB_MAX_STAGES]; // per channel filter state
+    float *z2[PPG_FB_MAX_STAGES];
+
+    int ma_len; // 0 or 1 disables the moving average
+    int ma_pos;
+    float *ma_hist; // ma_len rows of stride samples
+    float *ma_sum;
+
+    int use_avx2; // picked by ppg_fb_init(), may be cleared to force the scalar path
+    void *mem;
+} ppg_filterbank;
+
+/**
+ * @brief Butterworth (Q = 1/sqrt(2)) low or high pass section
+ *
+ * @param c Coefficients to fill
+ * @param cutoff_hz Corner frequency
+ * @param sample_rate_hz Sample rate
+ * @param high_pass Non-zero for a high pass, zero for a low pass
+ */
+void ppg_fb_design(ppg_fb_coeffs *c, float cutoff_hz, float sample_rate_hz, int high_pass);
+
+/**
+ * @brief Set up a filter bank; all memory is allocated here
+ *
+ * @return 0 on success, -1 on bad arguments or allocation failure
+ */
+int ppg_fb_init(ppg_filterbank *fb, int channels, const ppg_fb_coeffs *stages, int nstages, int ma_len);
+
+void ppg_fb_free(ppg_filterbank *fb);
+
+/**
+ * @brief Filter a block of nsamples interleaved samples
+ *
+ * in and out hold nsamples * fb->stride floats and may be the same buffer.
+ * Padding channels are processed but carry no meaning.
+ */
+void ppg_fb_process(ppg_filterbank *fb, const float *in, float *out, int nsamples);
+
+/**
+ * @brief Copy driver records of one sensor into an interleaved block
+ *
+ * IR goes to channel 2 * sensor and Red to channel 2 * sensor + 1.
+ */
+void ppg_fb_put_records(const ppg_filterbank *fb, float *block, int sensor, const struct max30100_record *recs,
+                        int nrecs);
+
+#endif // PPG_FILTERBANK_H